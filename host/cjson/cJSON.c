@@ -0,0 +1,276 @@
+/**
+ * Host build - minimal recursive-descent JSON parser behind the cJSON API
+ * Handles everything WiZ bulbs and the coordination protocol send; \u escapes
+ * outside ASCII are replaced with '?'.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cJSON.h"
+
+#define CJSON_MAX_DEPTH 32
+
+typedef struct {
+    const char *p;
+    int depth;
+} parser_t;
+
+static cJSON *parse_value(parser_t *ps);
+
+static void skip_ws(parser_t *ps)
+{
+    while (*ps->p && isspace((unsigned char)*ps->p)) {
+        ps->p++;
+    }
+}
+
+static cJSON *new_item(int type)
+{
+    cJSON *item = calloc(1, sizeof(cJSON));
+    if (item) {
+        item->type = type;
+    }
+    return item;
+}
+
+static char *parse_string_raw(parser_t *ps)
+{
+    if (*ps->p != '"') {
+        return NULL;
+    }
+    ps->p++;
+
+    size_t cap = 16, len = 0;
+    char *out = malloc(cap);
+    if (out == NULL) {
+        return NULL;
+    }
+
+    while (*ps->p && *ps->p != '"') {
+        char c = *ps->p++;
+        if (c == '\\') {
+            c = *ps->p++;
+            switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                unsigned code = 0;
+                for (int i = 0; i < 4; i++) {
+                    if (!isxdigit((unsigned char)*ps->p)) {
+                        free(out);
+                        return NULL;
+                    }
+                    char h = *ps->p++;
+                    code = code * 16 + (unsigned)(isdigit((unsigned char)h) ? h - '0' : (tolower((unsigned char)h) - 'a' + 10));
+                }
+                c = code < 0x80 ? (char)code : '?';
+                break;
+            }
+            case '"': case '\\': case '/':
+                break;
+            default:
+                free(out);
+                return NULL;
+            }
+        }
+        if (len + 2 > cap) {
+            cap *= 2;
+            char *grown = realloc(out, cap);
+            if (grown == NULL) {
+                free(out);
+                return NULL;
+            }
+            out = grown;
+        }
+        out[len++] = c;
+    }
+
+    if (*ps->p != '"') {
+        free(out);
+        return NULL;
+    }
+    ps->p++;
+    out[len] = '\0';
+    return out;
+}
+
+static cJSON *parse_container(parser_t *ps, bool object)
+{
+    if (++ps->depth > CJSON_MAX_DEPTH) {
+        return NULL;
+    }
+    cJSON *item = new_item(object ? cJSON_Object : cJSON_Array);
+    if (item == NULL) {
+        return NULL;
+    }
+    ps->p++;  // '{' or '['
+
+    cJSON *last = NULL;
+    skip_ws(ps);
+    if (*ps->p == (object ? '}' : ']')) {
+        ps->p++;
+        ps->depth--;
+        return item;
+    }
+
+    while (1) {
+        char *name = NULL;
+        skip_ws(ps);
+        if (object) {
+            name = parse_string_raw(ps);
+            skip_ws(ps);
+            if (name == NULL || *ps->p != ':') {
+                free(name);
+                cJSON_Delete(item);
+                return NULL;
+            }
+            ps->p++;
+        }
+
+        cJSON *child = parse_value(ps);
+        if (child == NULL) {
+            free(name);
+            cJSON_Delete(item);
+            return NULL;
+        }
+        child->string = name;
+        if (last) {
+            last->next = child;
+            child->prev = last;
+        } else {
+            item->child = child;
+        }
+        last = child;
+
+        skip_ws(ps);
+        if (*ps->p == ',') {
+            ps->p++;
+            continue;
+        }
+        if (*ps->p == (object ? '}' : ']')) {
+            ps->p++;
+            ps->depth--;
+            return item;
+        }
+        cJSON_Delete(item);
+        return NULL;
+    }
+}
+
+static cJSON *parse_value(parser_t *ps)
+{
+    skip_ws(ps);
+    const char *p = ps->p;
+
+    if (*p == '{' || *p == '[') {
+        return parse_container(ps, *p == '{');
+    }
+    if (*p == '"') {
+        char *s = parse_string_raw(ps);
+        cJSON *item = s ? new_item(cJSON_String) : NULL;
+        if (item) {
+            item->valuestring = s;
+        } else {
+            free(s);
+        }
+        return item;
+    }
+    if (strncmp(p, "true", 4) == 0) {
+        ps->p += 4;
+        return new_item(cJSON_True);
+    }
+    if (strncmp(p, "false", 5) == 0) {
+        ps->p += 5;
+        return new_item(cJSON_False);
+    }
+    if (strncmp(p, "null", 4) == 0) {
+        ps->p += 4;
+        return new_item(cJSON_NULL);
+    }
+    if (*p == '-' || isdigit((unsigned char)*p)) {
+        char *end;
+        double d = strtod(p, &end);
+        if (end == p) {
+            return NULL;
+        }
+        cJSON *item = new_item(cJSON_Number);
+        if (item) {
+            item->valuedouble = d;
+            item->valueint = d >= 2147483647.0 ? 2147483647 : d <= -2147483648.0 ? (-2147483647 - 1) : (int)d;
+        }
+        ps->p = end;
+        return item;
+    }
+    return NULL;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    if (value == NULL) {
+        return NULL;
+    }
+    parser_t ps = { value, 0 };
+    return parse_value(&ps);
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while (item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+// Case-insensitive like upstream cJSON_GetObjectItem
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string)
+{
+    if (object == NULL || string == NULL) {
+        return NULL;
+    }
+    for (cJSON *child = object->child; child; child = child->next) {
+        if (child->string && strcasecmp(child->string, string) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+cJSON_bool cJSON_IsBool(const cJSON *item)
+{
+    return item && (item->type & (cJSON_True | cJSON_False));
+}
+
+cJSON_bool cJSON_IsTrue(const cJSON *item)
+{
+    return item && (item->type & cJSON_True);
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item)
+{
+    return item && (item->type & cJSON_Number);
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item)
+{
+    return item && (item->type & cJSON_String);
+}
+
+cJSON_bool cJSON_IsArray(const cJSON *item)
+{
+    return item && (item->type & cJSON_Array);
+}
+
+cJSON_bool cJSON_IsObject(const cJSON *item)
+{
+    return item && (item->type & cJSON_Object);
+}
@@ -0,0 +1,45 @@
+/**
+ * Host build - the subset of the cJSON API the firmware uses
+ * Same types and semantics as the cJSON component that ships with ESP-IDF.
+ */
+
+#ifndef HOST_CJSON_H
+#define HOST_CJSON_H
+
+#define cJSON_Invalid 0
+#define cJSON_False   (1 << 0)
+#define cJSON_True    (1 << 1)
+#define cJSON_NULL    (1 << 2)
+#define cJSON_Number  (1 << 3)
+#define cJSON_String  (1 << 4)
+#define cJSON_Array   (1 << 5)
+#define cJSON_Object  (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON *cJSON_Parse(const char *value);
+void cJSON_Delete(cJSON *item);
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
+
+cJSON_bool cJSON_IsBool(const cJSON *item);
+cJSON_bool cJSON_IsTrue(const cJSON *item);
+cJSON_bool cJSON_IsNumber(const cJSON *item);
+cJSON_bool cJSON_IsString(const cJSON *item);
+cJSON_bool cJSON_IsArray(const cJSON *item);
+cJSON_bool cJSON_IsObject(const cJSON *item);
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
+
+#endif // HOST_CJSON_H
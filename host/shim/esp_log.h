@@ -0,0 +1,16 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+#include "esp_timer.h"
+
+// Same line format as the ESP-IDF console; debug output is compiled out
+#define HOST_LOG(level, tag, fmt, ...) \
+    printf(level " (%lld) %s: " fmt "\n", (long long)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { if (0) HOST_LOG("D", tag, fmt, ##__VA_ARGS__); } while (0)
+
+#endif // HOST_ESP_LOG_H
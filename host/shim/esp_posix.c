@@ -0,0 +1,406 @@
+/**
+ * Host shim - ESP-IDF services the firmware uses: timer, events, WiFi, NVS, GPIO
+ * Also provides main(), which runs app_main() like the IDF startup code does.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "driver/gpio.h"
+#include "lwip/ip4_addr.h"
+
+#define HOST_MAX_HANDLERS   4
+#define HOST_NVS_MAX_KEYS   16
+#define HOST_NVS_MAX_BLOB   8192
+
+void app_main(void);
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+// ========== Timer ==========
+
+int64_t esp_timer_get_time(void)
+{
+    static struct timespec start;
+    static bool started = false;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!started) {
+        start = now;
+        started = true;
+    }
+    return (int64_t)(now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:     return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+    default:                        return "UNKNOWN ERROR";
+    }
+}
+
+// ========== Event Loop ==========
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} host_handler_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    ip_event_got_ip_t got_ip;
+} host_event_t;
+
+static host_handler_t handlers[HOST_MAX_HANDLERS];
+static int num_handlers = 0;
+static QueueHandle_t event_queue = NULL;
+
+/**
+ * Handlers run on their own task, as they do on the IDF default event loop
+ */
+static void host_event_task(void *arg)
+{
+    host_event_t event;
+    while (xQueueReceive(event_queue, &event, portMAX_DELAY) == pdTRUE) {
+        for (int i = 0; i < num_handlers; i++) {
+            if (handlers[i].base == event.base &&
+                (handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event.id)) {
+                handlers[i].handler(handlers[i].arg, event.base, event.id, &event.got_ip);
+            }
+        }
+    }
+}
+
+static void host_post(esp_event_base_t base, int32_t id)
+{
+    host_event_t event = { .base = base, .id = id };
+    event.got_ip.ip_info.ip.addr = htonl(INADDR_LOOPBACK);
+    xQueueSend(event_queue, &event, portMAX_DELAY);
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    event_queue = xQueueCreate(8, sizeof(host_event_t));
+    if (event_queue == NULL || xTaskCreate(host_event_task, "sys_evt", 4096, NULL, 20, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                              void *arg, esp_event_handler_instance_t *instance)
+{
+    if (num_handlers >= HOST_MAX_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    handlers[num_handlers] = (host_handler_t){ base, id, handler, arg };
+    if (instance) {
+        *instance = &handlers[num_handlers];
+    }
+    num_handlers++;
+    return ESP_OK;
+}
+
+// ========== WiFi ==========
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+void *esp_netif_create_default_wifi_sta(void)
+{
+    return NULL;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t iface, wifi_config_t *config)
+{
+    (void)iface;
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    host_post(WIFI_EVENT, WIFI_EVENT_STA_START);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    host_post(IP_EVENT, IP_EVENT_STA_GOT_IP);
+    return ESP_OK;
+}
+
+/**
+ * Station MAC with the last four bytes taken from WIZ_CONTROLLER_ID if it is set,
+ * otherwise from the process ID
+ */
+esp_err_t esp_wifi_get_mac(wifi_interface_t iface, uint8_t mac[6])
+{
+    (void)iface;
+    const char *env = getenv("WIZ_CONTROLLER_ID");
+    uint32_t id = env ? (uint32_t)strtoul(env, NULL, 0) : (uint32_t)getpid();
+
+    mac[0] = 0x02;  // Locally administered
+    mac[1] = 0x00;
+    mac[2] = (id >> 24) & 0xff;
+    mac[3] = (id >> 16) & 0xff;
+    mac[4] = (id >> 8) & 0xff;
+    mac[5] = id & 0xff;
+    return ESP_OK;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr)
+{
+    static __thread char buf[16];
+    struct in_addr in = { .s_addr = addr->addr };
+    return (char *)inet_ntop(AF_INET, &in, buf, sizeof(buf));
+}
+
+// ========== NVS ==========
+
+typedef struct {
+    bool used;
+    char ns[16];
+    char key[16];
+    size_t size;
+    uint8_t data[HOST_NVS_MAX_BLOB];
+} host_nvs_entry_t;
+
+typedef struct {
+    bool used;
+    char ns[16];
+    bool writable;
+} host_nvs_handle_t;
+
+static host_nvs_entry_t nvs_entries[HOST_NVS_MAX_KEYS];
+static host_nvs_handle_t nvs_handles[8];
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool nvs_initialized = false;
+
+esp_err_t nvs_flash_init(void)
+{
+    nvs_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    if (!nvs_initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    for (int i = 0; i < (int)(sizeof(nvs_handles) / sizeof(nvs_handles[0])); i++) {
+        if (!nvs_handles[i].used) {
+            nvs_handles[i].used = true;
+            nvs_handles[i].writable = mode == NVS_READWRITE;
+            strncpy(nvs_handles[i].ns, name, sizeof(nvs_handles[i].ns) - 1);
+            *handle = i + 1;
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    memset(&nvs_handles[handle - 1], 0, sizeof(nvs_handles[0]));
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+// Caller holds nvs_lock
+static host_nvs_entry_t *host_nvs_find(nvs_handle_t handle, const char *key, bool create)
+{
+    const char *ns = nvs_handles[handle - 1].ns;
+    host_nvs_entry_t *free_slot = NULL;
+
+    for (int i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        host_nvs_entry_t *entry = &nvs_entries[i];
+        if (entry->used && strcmp(entry->ns, ns) == 0 && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+        if (!entry->used && free_slot == NULL) {
+            free_slot = entry;
+        }
+    }
+
+    if (create && free_slot) {
+        free_slot->used = true;
+        strncpy(free_slot->ns, ns, sizeof(free_slot->ns) - 1);
+        strncpy(free_slot->key, key, sizeof(free_slot->key) - 1);
+        return free_slot;
+    }
+    return NULL;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    for (int i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        if (nvs_entries[i].used && strcmp(nvs_entries[i].ns, nvs_handles[handle - 1].ns) == 0) {
+            memset(&nvs_entries[i], 0, sizeof(nvs_entries[i]));
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    pthread_mutex_lock(&nvs_lock);
+    host_nvs_entry_t *entry = host_nvs_find(handle, key, false);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (out != NULL) {
+        if (*length < entry->size) {
+            ret = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(out, entry->data, entry->size);
+        }
+    }
+    *length = entry->size;
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (length > HOST_NVS_MAX_BLOB) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    host_nvs_entry_t *entry = nvs_handles[handle - 1].writable ? host_nvs_find(handle, key, true) : NULL;
+    if (entry) {
+        memcpy(entry->data, value, length);
+        entry->size = length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return entry ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out)
+{
+    size_t length = sizeof(*out);
+    return nvs_get_blob(handle, key, out, &length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+// ========== GPIO ==========
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+    (void)pin;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    (void)pin;
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    (void)pin;
+    (void)level;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    (void)pin;
+    return 1;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    (void)flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void *arg)
+{
+    (void)pin;
+    (void)handler;
+    (void)arg;
+    return ESP_OK;
+}
+
+// ========== Startup ==========
+
+int main(void)
+{
+    // Logs are read line by line by the test harness
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    esp_timer_get_time();
+    app_main();
+    return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * Host shim - the station "connects" as soon as it is started and never drops
+ * The station MAC carries WIZ_CONTROLLER_ID from the environment, so several
+ * controllers on one host get distinct coordination IDs.
+ */
+
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct { int unused; } wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+typedef union {
+    struct {
+        uint8_t ssid[32];
+        uint8_t password[64];
+    } sta;
+} wifi_config_t;
+
+typedef enum { WIFI_MODE_STA = 1 } wifi_mode_t;
+typedef enum { WIFI_IF_STA = 0 } wifi_interface_t;
+
+enum {
+    WIFI_EVENT_STA_START = 2,
+    WIFI_EVENT_STA_DISCONNECTED = 5,
+};
+
+enum {
+    IP_EVENT_STA_GOT_IP = 0,
+};
+
+typedef struct { uint32_t addr; } esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    void *esp_netif;
+    esp_netif_ip_info_t ip_info;
+} ip_event_got_ip_t;
+
+esp_err_t esp_netif_init(void);
+void *esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t iface, wifi_config_t *config);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_get_mac(wifi_interface_t iface, uint8_t mac[6]);
+
+#endif // HOST_ESP_WIFI_H
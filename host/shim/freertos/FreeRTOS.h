@@ -0,0 +1,36 @@
+/**
+ * Host shim - FreeRTOS types on top of POSIX threads
+ * Ticks are 1 ms so timing matches the firmware's millisecond constants.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+typedef struct host_task *TaskHandle_t;
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_sem *SemaphoreHandle_t;
+
+// Static allocation buffers are unused on the host - objects are heap allocated
+typedef struct { int unused; } StaticSemaphore_t;
+typedef struct { int unused; } StaticQueue_t;
+
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms))
+#define portTICK_PERIOD_MS    1
+#define portMAX_DELAY         ((TickType_t)0xffffffffu)
+#define pdTRUE                1
+#define pdFALSE               0
+#define pdPASS                1
+#define pdFAIL                0
+#define IRAM_ATTR
+#define portYIELD_FROM_ISR(x) (void)(x)
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,18 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+#define xSemaphoreCreateBinary()                     xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreCreateBinaryStatic(buf)            ((void)(buf), xSemaphoreCreateCounting(1, 0))
+#define xSemaphoreCreateCountingStatic(max, init, buf) ((void)(buf), xSemaphoreCreateCounting(max, init))
+#define xSemaphoreCreateMutexStatic(buf)             ((void)(buf), xSemaphoreCreateMutex())
+
+#endif // HOST_FREERTOS_SEMPHR_H
@@ -0,0 +1,20 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+} eNotifyAction;
+
+BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack_depth,
+                       void *param, UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks);
+
+#endif // HOST_FREERTOS_TASK_H
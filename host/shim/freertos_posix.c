@@ -0,0 +1,359 @@
+/**
+ * Host shim - FreeRTOS tasks, queues, semaphores and notifications on POSIX threads
+ * Priorities are ignored; the firmware must not rely on them for correctness.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+struct host_task {
+    pthread_t thread;
+    void (*entry)(void *);
+    void *param;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+};
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+static __thread struct host_task *current_task = NULL;
+
+static void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Absolute CLOCK_MONOTONIC deadline for a tick timeout
+ */
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+/**
+ * Wait on cond until woken or the timeout passes. Returns false on timeout.
+ */
+static bool host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct host_task *host_task_alloc(void)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task) {
+        pthread_mutex_init(&task->lock, NULL);
+        host_cond_init(&task->cond);
+    }
+    return task;
+}
+
+/**
+ * The thread that runs app_main() has no task object until it needs one
+ */
+static struct host_task *host_self(void)
+{
+    if (current_task == NULL) {
+        current_task = host_task_alloc();
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+static void *host_task_main(void *arg)
+{
+    struct host_task *task = arg;
+    current_task = task;
+    task->entry(task->param);
+    return NULL;
+}
+
+// ========== Tasks ==========
+
+BaseType_t xTaskCreate(void (*entry)(void *), const char *name, uint32_t stack_depth,
+                       void *param, UBaseType_t priority, TaskHandle_t *handle)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+
+    struct host_task *task = host_task_alloc();
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->entry = entry;
+    task->param = param;
+
+    if (pthread_create(&task->thread, NULL, host_task_main, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { .tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    pthread_mutex_lock(&task->lock);
+    if (action == eSetBits) {
+        task->notify_value |= value;
+    }
+    task->notify_pending = true;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    struct host_task *task = host_self();
+    struct timespec deadline = host_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    BaseType_t got = pdTRUE;
+
+    pthread_mutex_lock(&task->lock);
+    if (!task->notify_pending) {
+        task->notify_value &= ~clear_on_entry;
+    }
+    while (!task->notify_pending) {
+        if (!host_wait(&task->cond, &task->lock, ticks, &deadline)) {
+            got = pdFALSE;
+            break;
+        }
+    }
+    if (value) {
+        *value = task->notify_value;
+    }
+    if (got) {
+        task->notify_pending = false;
+        task->notify_value &= ~clear_on_exit;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return got;
+}
+
+// ========== Queues ==========
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = calloc(length, item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    host_cond_init(&queue->cond);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+static BaseType_t host_queue_put(QueueHandle_t queue, const void *item, TickType_t ticks, bool front)
+{
+    struct timespec deadline = host_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (!host_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+
+    UBaseType_t slot;
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    memcpy(queue->items + slot * queue->item_size, item, queue->item_size);
+    queue->count++;
+
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+static BaseType_t host_queue_get(QueueHandle_t queue, void *item, TickType_t ticks, bool remove)
+{
+    struct timespec deadline = host_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (!host_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return host_queue_put(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return host_queue_put(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return host_queue_get(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return host_queue_get(queue, item, ticks, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+// ========== Semaphores ==========
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    host_cond_init(&sem->cond);
+    sem->max = max;
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (!host_wait(&sem->cond, &sem->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&sem->lock);
+            return pdFALSE;
+        }
+    }
+    sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t given = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        given = pdTRUE;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
@@ -0,0 +1,9 @@
+#ifndef HOST_LWIP_INET_H
+#define HOST_LWIP_INET_H
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#define inet_ntoa_r(addr, buf, buflen) inet_ntop(AF_INET, &(addr), (buf), (buflen))
+
+#endif // HOST_LWIP_INET_H
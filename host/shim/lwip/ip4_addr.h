@@ -0,0 +1,10 @@
+#ifndef HOST_LWIP_IP4_ADDR_H
+#define HOST_LWIP_IP4_ADDR_H
+
+#include <stdint.h>
+
+typedef struct { uint32_t addr; } ip4_addr_t;
+
+char *ip4addr_ntoa(const ip4_addr_t *addr);
+
+#endif // HOST_LWIP_IP4_ADDR_H
@@ -0,0 +1,10 @@
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+// The host's BSD sockets stand in for lwIP's
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#endif // HOST_LWIP_SOCKETS_H
@@ -0,0 +1,33 @@
+/**
+ * Host shim - NVS kept in memory, so every process starts from a blank flash
+ */
+
+#ifndef HOST_NVS_H
+#define HOST_NVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_BASE            0x1100
+#define ESP_ERR_NVS_NOT_INITIALIZED (ESP_ERR_NVS_BASE + 0x01)
+#define ESP_ERR_NVS_NOT_FOUND       (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH  (ESP_ERR_NVS_BASE + 0x0c)
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_erase_all(nvs_handle_t handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out);
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value);
+
+#endif // HOST_NVS_H
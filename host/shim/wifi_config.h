@@ -0,0 +1,8 @@
+// Host build credentials - the shim station ignores them
+#ifndef WIFI_CONFIG_H
+#define WIFI_CONFIG_H
+
+#define WIFI_SSID      "host"
+#define WIFI_PASSWORD  "host"
+
+#endif // WIFI_CONFIG_H
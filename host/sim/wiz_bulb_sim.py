@@ -0,0 +1,176 @@
+"""WiZ bulb simulator for the host build.
+
+Each bulb answers on its own loopback address (127.0.0.2, 127.0.0.3, ...) on
+port 38899 like a real bulb on the LAN. A wildcard socket on the same port
+takes the controller's discovery "broadcast" (the host build sends it to
+127.0.0.1) and every bulb replies to it from its own address.
+
+The first six bulbs use the MAC addresses configured in main/main.c, so the
+default scenes, groups and switches find them; further bulbs get generated MACs.
+
+Run standalone with `python3 wiz_bulb_sim.py --bulbs 30`, or import BulbSim
+from a test.
+"""
+
+import argparse
+import json
+import select
+import socket
+import threading
+import time
+
+WIZ_PORT = 38899
+
+CONFIGURED_MACS = [
+    "444f8e26e756", "444f8e26e796", "d8a01162bc9e",
+    "d8a01162ba16", "444f8e308782", "d8a01170b374",
+]
+
+
+def bulb_mac(index):
+    if index < len(CONFIGURED_MACS):
+        return CONFIGURED_MACS[index]
+    return "a8bb50%06x" % index
+
+
+class Bulb:
+    def __init__(self, index):
+        self.mac = bulb_mac(index)
+        self.ip = "127.0.0.%d" % (index + 2)
+        self.on = False
+        self.dimming = 100
+        self.temp = 2700
+        self.commands = []  # (monotonic time, on) for every setPilot received
+
+    def pilot(self):
+        return {"mac": self.mac, "rssi": -50, "state": self.on,
+                "sceneId": 0, "dimming": self.dimming, "temp": self.temp}
+
+
+class BulbSim:
+    def __init__(self, num_bulbs):
+        self.bulbs = [Bulb(i) for i in range(num_bulbs)]
+        self.lock = threading.Lock()
+        self.sockets = {}
+        self.running = False
+        self.thread = None
+
+    def start(self):
+        discovery = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        discovery.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        discovery.bind(("0.0.0.0", WIZ_PORT))
+        self.sockets[discovery] = None
+
+        for bulb in self.bulbs:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+            sock.bind((bulb.ip, WIZ_PORT))
+            self.sockets[sock] = bulb
+
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+        return self
+
+    def stop(self):
+        self.running = False
+        if self.thread:
+            self.thread.join()
+        for sock in self.sockets:
+            sock.close()
+        self.sockets.clear()
+
+    def _run(self):
+        while self.running:
+            ready, _, _ = select.select(list(self.sockets), [], [], 0.1)
+            for sock in ready:
+                try:
+                    data, addr = sock.recvfrom(2048)
+                except OSError:
+                    continue
+                bulb = self.sockets[sock]
+                if bulb is None:
+                    self._discovery(data, addr)
+                else:
+                    self._command(sock, bulb, data, addr)
+
+    def _discovery(self, data, addr):
+        try:
+            msg = json.loads(data)
+        except ValueError:
+            return
+        if msg.get("method") != "getPilot":
+            return
+        # Every bulb answers the broadcast from its own address
+        for sock, bulb in self.sockets.items():
+            if bulb is not None:
+                with self.lock:
+                    reply = {"method": "getPilot", "env": "pro", "result": bulb.pilot()}
+                if "id" in msg:
+                    reply["id"] = msg["id"]
+                sock.sendto(json.dumps(reply, separators=(",", ":")).encode(), addr)
+
+    def _command(self, sock, bulb, data, addr):
+        try:
+            msg = json.loads(data)
+        except ValueError:
+            return
+        method = msg.get("method")
+        params = msg.get("params", {})
+
+        with self.lock:
+            if method == "setPilot":
+                if "state" in params:
+                    bulb.on = bool(params["state"])
+                bulb.dimming = params.get("dimming", bulb.dimming)
+                bulb.temp = params.get("temp", bulb.temp)
+                bulb.commands.append((time.monotonic(), bulb.on))
+                reply = {"method": "setPilot", "env": "pro", "result": {"success": True}}
+            elif method == "getPilot":
+                reply = {"method": "getPilot", "env": "pro", "result": bulb.pilot()}
+            else:
+                reply = {"method": method, "env": "pro",
+                         "error": {"code": -32601, "message": "Method not found"}}
+        # Real bulbs echo the request id
+        if "id" in msg:
+            reply["id"] = msg["id"]
+
+        sock.sendto(json.dumps(reply, separators=(",", ":")).encode(), addr)
+
+    def states(self):
+        with self.lock:
+            return {bulb.mac: bulb.on for bulb in self.bulbs}
+
+    def commands_since(self, since):
+        """setPilot commands received after a monotonic timestamp, as (mac, on) pairs."""
+        with self.lock:
+            return [(bulb.mac, on) for bulb in self.bulbs for t, on in bulb.commands if t >= since]
+
+    def wait_states(self, expected, timeout):
+        """Wait until every bulb in expected (mac -> on) matches. Returns True on success."""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            current = self.states()
+            if all(current[mac] == on for mac, on in expected.items()):
+                return True
+            time.sleep(0.02)
+        return False
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bulbs", type=int, default=len(CONFIGURED_MACS))
+    args = parser.parse_args()
+
+    sim = BulbSim(args.bulbs).start()
+    for bulb in sim.bulbs:
+        print("bulb %s at %s:%d" % (bulb.mac, bulb.ip, WIZ_PORT))
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        sim.stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+"""Helpers shared by the host tests: controller processes and the control protocol."""
+
+import json
+import os
+import re
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+from wiz_bulb_sim import BulbSim
+
+COORD_GROUP = "239.255.38.99"
+COORD_PORT = 38900
+
+CONTROLLER_BIN = os.environ.get("WIZ_CONTROLLER_BIN", "wiz_controller")
+CONTROLLER_TXQ_BIN = os.environ.get("WIZ_CONTROLLER_TXQ_BIN", "wiz_controller_txq")
+
+
+class Controller:
+    """One wiz_controller process with a fixed controller ID."""
+
+    def __init__(self, controller_id, env=None, binary=None):
+        self.id = controller_id
+        self.binary = binary or CONTROLLER_BIN
+        self.extra_env = env or {}
+        self.proc = None
+        self.lines = []
+        self.lock = threading.Lock()
+
+    def start(self):
+        env = dict(os.environ, WIZ_CONTROLLER_ID=str(self.id), **self.extra_env)
+        with self.lock:
+            self.lines = []
+        self.proc = subprocess.Popen([self.binary], env=env, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT, text=True, bufsize=1)
+        threading.Thread(target=self._reader, args=(self.proc,), daemon=True).start()
+        return self
+
+    def _reader(self, proc):
+        for line in proc.stdout:
+            with self.lock:
+                self.lines.append(line.rstrip("\n"))
+
+    def wait_log(self, pattern, timeout):
+        """Wait for a log line matching pattern and return the match."""
+        regex = re.compile(pattern)
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            with self.lock:
+                for line in self.lines:
+                    match = regex.search(line)
+                    if match:
+                        return match
+            if self.proc.poll() is not None:
+                break
+            time.sleep(0.05)
+        self.dump()
+        raise AssertionError("controller %08x: no log line matching %r" % (self.id, pattern))
+
+    def wait_ready(self, timeout=20):
+        self.wait_log(r"System ready!", timeout)
+
+    def kill(self):
+        if self.proc and self.proc.poll() is None:
+            self.proc.kill()
+            self.proc.wait()
+
+    def dump(self, last=60):
+        with self.lock:
+            tail = self.lines[-last:]
+        sys.stderr.write("---- controller %08x log ----\n" % self.id)
+        for line in tail:
+            sys.stderr.write(line + "\n")
+
+
+def control(target, cmd, timeout=5.0, **fields):
+    """Send a control command to one controller via the coordination group and return its reply."""
+    msg = dict(type="control", target=target, cmd=cmd, **fields)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0.2)
+    try:
+        sock.sendto(json.dumps(msg).encode(), (COORD_GROUP, COORD_PORT))
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            try:
+                data, _ = sock.recvfrom(4096)
+            except socket.timeout:
+                continue
+            reply = json.loads(data)
+            if reply.get("type") == "control_reply" and reply.get("id") == target:
+                return reply
+    finally:
+        sock.close()
+    raise AssertionError("no reply from controller %08x to %r" % (target, cmd))
+
+
+class Fixture:
+    """Simulator plus controllers, torn down on exit even when a check fails."""
+
+    def __init__(self, num_bulbs):
+        self.sim = BulbSim(num_bulbs)
+        self.controllers = []
+
+    def controller(self, controller_id, env=None, binary=None):
+        ctrl = Controller(controller_id, env, binary)
+        self.controllers.append(ctrl)
+        return ctrl
+
+    def __enter__(self):
+        self.sim.start()
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        for ctrl in self.controllers:
+            if exc_type is not None:
+                ctrl.dump()
+            ctrl.kill()
+        self.sim.stop()
+        return False
+
+
+def check(condition, message):
+    if not condition:
+        raise AssertionError(message)
+    print("ok - " + message, flush=True)
@@ -0,0 +1,63 @@
+"""TX backpressure: a 30-bulb group applied repeatedly, with and without a full TX queue.
+
+The plain build sends into the host stack, which never refuses a datagram. The
+fault-injection build (WIZ_NET_TXQ_SLOTS=8, WIZ_NET_TXQ_RATE=200) refuses sends
+with ESP_ERR_NO_MEM once eight datagrams are queued. Every apply must still
+reach all 30 bulbs with nothing dropped, and the TX capacity must have been cut
+from its initial value. Bursts are paced by that capacity, so refusals must stay
+far below the number of commands. Sustained commands/sec is reported for both builds.
+"""
+
+from harness import CONTROLLER_BIN, CONTROLLER_TXQ_BIN, Fixture, check, control
+
+CONTROLLER = 0x0000C001
+BULBS = 30
+APPLIES = 10
+TXQ_RATE = 200
+TX_CAPACITY_INIT = 32
+
+
+def run(binary, label):
+    with Fixture(BULBS) as fx:
+        ctrl = fx.controller(CONTROLLER, binary=binary).start()
+        ctrl.wait_ready()
+
+        macs = [bulb.mac for bulb in fx.sim.bulbs]
+        reply = control(CONTROLLER, "store_group", name="bench", bulbs=macs)
+        check(reply["ok"], "%s: stored a %d-bulb group" % (label, BULBS))
+
+        total_ms = 0
+        for i in range(APPLIES):
+            on = i % 2 == 0
+            reply = control(CONTROLLER, "group", name="bench", on=on)
+            check(reply["ok"] and reply["acked"] == BULBS,
+                  "%s: apply %d acked by %d/%d bulbs in %d ms"
+                  % (label, i + 1, reply["acked"], BULBS, reply["ms"]))
+            check(fx.sim.wait_states({mac: on for mac in macs}, 2), "%s: apply %d reached every bulb" % (label, i + 1))
+            total_ms += reply["ms"]
+
+        stats = control(CONTROLLER, "stats")
+        rate = BULBS * APPLIES * 1000.0 / max(total_ms, 1)
+        print("%s: %d commands in %d ms of bursts = %.0f commands/sec "
+              "(backpressure=%d requeues=%d dropped=%d capacity=%d)"
+              % (label, BULBS * APPLIES, total_ms, rate, stats["backpressure"],
+                 stats["requeues"], stats["dropped"], stats["capacity"]), flush=True)
+        return rate, stats
+
+
+def main():
+    _, stats = run(CONTROLLER_BIN, "plain")
+    check(stats["backpressure"] == 0, "plain: host stack never refused a datagram")
+
+    rate, stats = run(CONTROLLER_TXQ_BIN, "txq")
+    check(stats["backpressure"] > 0, "txq: emulated TX queue refused %d sends" % stats["backpressure"])
+    check(stats["dropped"] == 0, "txq: refused datagrams were requeued, none dropped")
+    check(stats["backpressure"] <= BULBS * APPLIES // 20,
+          "txq: bursts paced by TX capacity, %d refusals for %d commands" % (stats["backpressure"], BULBS * APPLIES))
+    check(stats["capacity"] < TX_CAPACITY_INIT,
+          "txq: TX capacity cut from %d to %d" % (TX_CAPACITY_INIT, stats["capacity"]))
+    check(rate >= TXQ_RATE / 2, "txq: sustained %.0f commands/sec against a %d/s queue" % (rate, TXQ_RATE))
+
+
+if __name__ == "__main__":
+    main()
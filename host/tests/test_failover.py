@@ -0,0 +1,64 @@
+"""Two controllers sharing six bulbs: ownership split, failover and reboot.
+
+1. Both controllers start; a group change on A reaches all bulbs (A sends its
+   own share, B sends the bulbs it owns).
+2. A is killed; after the peer timeout B owns every bulb and applies a change
+   to all of them by itself.
+3. A restarts. Its switches read ON for most bulbs, but it must adopt the
+   group's state instead of reverting bulbs, and its first change after the
+   reboot must win over B's older versions.
+"""
+
+import time
+
+from harness import Fixture, check, control
+
+A = 0x0000A001
+B = 0x0000B002
+PEER_TIMEOUT_S = 3.5
+SYNC_INTERVAL_S = 2.0
+
+
+def main():
+    with Fixture(6) as fx:
+        sim = fx.sim
+        macs = [bulb.mac for bulb in sim.bulbs]
+        a = fx.controller(A).start()
+        b = fx.controller(B).start()
+        a.wait_ready()
+        b.wait_ready()
+        a.wait_log(r"Controller 0000b002 joined", 5)
+        b.wait_log(r"Controller 0000a001 joined", 5)
+
+        reply = control(A, "group", name="all", on=True)
+        check(reply["ok"], "group ON via A acked by every bulb A sends to")
+        check(reply["handed"] > 0, "A handed %d bulbs to B" % reply["handed"])
+        check(sim.wait_states({mac: True for mac in macs}, 3), "all bulbs ON with both controllers up")
+
+        a.kill()
+        time.sleep(PEER_TIMEOUT_S + 0.5)
+        b.wait_log(r"Controller 0000a001 lost, took over \d+ bulbs", 2)
+
+        reply = control(B, "group", name="all", on=False)
+        check(reply["ok"] and reply["acked"] == 6 and reply["handed"] == 0,
+              "B alone sent to all 6 bulbs after failover (acked=%d handed=%d)"
+              % (reply["acked"], reply["handed"]))
+        check(sim.wait_states({mac: False for mac in macs}, 3), "all bulbs OFF after failover")
+
+        rebooted_at = time.monotonic()
+        a.start()
+        a.wait_ready()
+        time.sleep(2 * SYNC_INTERVAL_S)
+        reverted = [mac for mac, on in sim.commands_since(rebooted_at) if on]
+        check(not reverted, "rebooted A did not turn any bulb back ON (%s)" % ", ".join(reverted))
+        check(all(not on for on in sim.states().values()), "all bulbs still OFF after A rejoined")
+
+        reply = control(A, "scene", name="bright", on=True)
+        check(reply["ok"], "scene via rebooted A acked")
+        check(sim.wait_states({mac: True for mac in macs}, 3), "all bulbs ON after A's scene")
+        time.sleep(2 * SYNC_INTERVAL_S)
+        check(all(sim.states().values()), "B's reconcile kept A's newer state (no tug-of-war)")
+
+
+if __name__ == "__main__":
+    main()
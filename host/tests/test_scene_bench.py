@@ -0,0 +1,72 @@
+"""Scene apply benchmark: time until every bulb has acked, for 6 and 30 bulbs.
+
+The 6-bulb case applies the default "evening" scene to the configured bulbs.
+The 30-bulb case stores a scene over the whole simulator through the control
+entry point (one datagram carrying all 30 entries) and applies it. Each scene
+is applied and turned off repeatedly. The controller's reported apply time
+(build payloads, burst, collect acks) is summarised per size. Scene entries
+with out-of-range values or malformed MACs must be refused by store_scene.
+"""
+
+import statistics
+
+from harness import Fixture, check, control
+
+CONTROLLER = 0x0000D001
+ROUNDS = 10
+ACK_TIMEOUT_MS = 500  # WIZ_SCENE_ACK_TIMEOUT_MS
+
+
+def bench(fx, scene, expected, label):
+    times = []
+    for i in range(ROUNDS):
+        for on in (True, False):
+            reply = control(CONTROLLER, "scene", name=scene, on=on)
+            check(reply["ok"] and reply["acked"] == len(expected),
+                  "%s round %d %s: %d/%d acked" % (label, i + 1, "apply" if on else "off",
+                                                   reply["acked"], len(expected)))
+            want = expected if on else {mac: False for mac in expected}
+            check(fx.sim.wait_states(want, 2), "%s round %d: bulbs match the scene" % (label, i + 1))
+            if on:
+                times.append(reply["ms"])
+
+    print("%s: apply-to-all-acked over %d runs: median %.1f ms, max %d ms"
+          % (label, len(times), statistics.median(times), max(times)), flush=True)
+    return times
+
+
+def main():
+    with Fixture(30) as fx:
+        ctrl = fx.controller(CONTROLLER).start()
+        ctrl.wait_ready()
+        bulbs = fx.sim.bulbs
+
+        # Default "evening" scene: the six configured bulbs, two of them off
+        evening = {bulb.mac: bulb.mac not in ("d8a01162ba16", "d8a01170b374") for bulb in bulbs[:6]}
+        times = bench(fx, "evening", evening, "6 bulbs")
+        check(max(times) < ACK_TIMEOUT_MS, "6 bulbs: every apply completed without a resend round")
+
+        entries = [{"mac": bulb.mac, "on": True, "dimming": 10 + (i * 3) % 90, "temp": 2700}
+                   for i, bulb in enumerate(bulbs)]
+        reply = control(CONTROLLER, "store_scene", name="all30", entries=entries)
+        check(reply["ok"], "stored a 30-bulb scene in one control datagram")
+
+        # Out-of-range values are refused, not wrapped into range and stored
+        mac = bulbs[0].mac
+        for bad in ({"mac": mac, "on": True, "dimming": 356}, {"mac": mac, "on": True, "temp": 68236},
+                    {"mac": mac, "on": True, "dimming": 5}, {"mac": "", "on": True},
+                    {"mac": "a8bb50zz0001", "on": True}):
+            reply = control(CONTROLLER, "store_scene", name="bad", entries=[bad])
+            check(not reply["ok"] and reply["err"] == "ESP_ERR_INVALID_ARG", "store_scene refused %r" % bad)
+        reply = control(CONTROLLER, "scene", name="bad", on=True)
+        check(not reply["ok"] and reply["err"] == "ESP_ERR_NOT_FOUND", "no refused scene was stored")
+        check("acked" not in reply, "unknown scene reply carries no counts from an earlier apply")
+
+        times = bench(fx, "all30", {bulb.mac: True for bulb in bulbs}, "30 bulbs")
+        check(max(times) < ACK_TIMEOUT_MS, "30 bulbs: every apply completed without a resend round")
+        check(all(bulb.dimming == entry["dimming"] for bulb, entry in zip(bulbs, entries)),
+              "30 bulbs: per-bulb brightness from the stored scene")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,12 +1,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "lwip/ip4_addr.h"
 #include "lwip/sockets.h"
 #include "lwip/inet.h"
@@ -16,6 +21,10 @@
 
 // WiZ Bulb Configuration
 #define WIZ_PORT       38899
+#ifndef WIZ_BROADCAST_IP
+#define WIZ_BROADCAST_IP "255.255.255.255"  // Overridden by the host build to reach the simulator
+#endif
+#define WIZ_PAYLOAD_MAX  160
 #define NUM_SWITCHES   5
 #define MAX_BULBS_PER_SWITCH 2
 
@@ -29,6 +38,188 @@
 // Status LED GPIO
 #define LED_STATUS_GPIO  2
 
+// Network scheduler configuration
+#define WIZ_NET_QUEUE_DEPTH          32    // Requests per priority class
+#define WIZ_NET_MAX_PENDING          40    // Outstanding requests awaiting a reply
+#define WIZ_NET_BG_MAX_PENDING       8     // Of those, how many background requests may hold
+#define WIZ_NET_REPLY_TIMEOUT_MS     2000  // Reply deadline for getPilot-style requests
+#define WIZ_NET_POLL_MS              10    // RX poll period while replies are outstanding
+#define WIZ_NET_BUDGET_WINDOW_MS     100   // TX budget accounting window
+#define WIZ_NET_CREDIT               1000000  // One datagram of TX budget, in millionths
+#define WIZ_NET_TX_CAPACITY_INIT     32    // Datagrams per window before any backpressure is seen
+#define WIZ_NET_TX_CAPACITY_MIN      4     // Floor after repeated backpressure
+#define WIZ_NET_TX_CAPACITY_MAX      64    // Ceiling for additive increase
+#define WIZ_NET_BACKOFF_MS           10    // Pause after the stack refuses a datagram
+#define WIZ_NET_MAX_REQUEUES         50    // Give up on a datagram refused this many times
+// Fault injection: emulate a TX queue of this many datagrams that drains at
+// WIZ_NET_TXQ_RATE per second, refusing sends with ESP_ERR_NO_MEM when full. 0 = off
+#ifndef WIZ_NET_TXQ_SLOTS
+#define WIZ_NET_TXQ_SLOTS            0
+#endif
+#ifndef WIZ_NET_TXQ_RATE
+#define WIZ_NET_TXQ_RATE             200
+#endif
+#define WIZ_NET_STATS_INTERVAL_MS    60000 // Queueing delay report period
+#define WIZ_NET_RECENT_INTERACTIVE   32    // Bulbs remembered for superseding stale reconcile sends
+#define WIZ_DISCOVERY_WINDOW_MS      3000  // How long discovery replies are accepted
+
+// Scene and group configuration
+#define WIZ_NAME_MAX             16
+#define WIZ_MAC_LEN              13    // 12 hex digits + terminator
+#define MAX_KNOWN_BULBS          32    // Bulbs remembered from discovery
+#define MAX_SCENES               8
+#define MAX_GROUPS               8
+#define MAX_SCENE_BULBS          32    // Bulbs per scene or group
+#define WIZ_SCENE_ACK_TIMEOUT_MS 500   // Per-bulb setPilot ack timeout
+#define WIZ_SCENE_MAX_ATTEMPTS   2     // Resend rounds for bulbs that did not ack
+#define WIZ_NVS_NAMESPACE        "wiz"
+#define WIZ_NVS_SCHEMA           1     // Bump when a persisted table layout changes
+
+// Multi-controller coordination over LAN multicast
+#define WIZ_COORD_GROUP            "239.255.38.99"
+#define WIZ_COORD_PORT             38900
+#define WIZ_COORD_HELLO_MS         1000  // Heartbeat period
+#define WIZ_COORD_PEER_TIMEOUT_MS  3500  // Peer considered gone after this much silence
+#define WIZ_COORD_RESYNC_PER_HELLO 4     // Desired-state entries re-announced per heartbeat
+#define MAX_PEERS                  8
+#define MAX_DESIRED                MAX_KNOWN_BULBS
+#define WIZ_COORD_RX_MAX           4096  // Fits a control message storing a full scene
+#define WIZ_CONTROL_QUEUE_LEN      (4 + MAX_DESIRED)  // Control commands plus states handed over by peers
+#define WIZ_HANDOFF_GATHER_MS      10    // Wait this long for more handed-over states before sending
+
+// Network traffic classes, highest priority first
+typedef enum {
+    WIZ_PRIO_INTERACTIVE = 0,  // Single user flips - always sent immediately
+    WIZ_PRIO_BURST,            // Scene/group fan-out and peer handoffs - paced by the TX budget
+    WIZ_PRIO_RECONCILE,        // Periodic sync of cached state
+    WIZ_PRIO_DISCOVERY,        // Discovery broadcasts and health probes
+    WIZ_PRIO_COUNT
+} wiz_prio_t;
+
+// A single datagram queued for the network task
+typedef struct {
+    wiz_prio_t prio;
+    char bulb_ip[16];
+    char payload[WIZ_PAYLOAD_MAX];
+    char method[16];              // Request method, used to match replies
+    uint32_t id;                  // JSON-RPC id sent with the datagram, echoed by the bulb
+    int64_t enqueue_us;
+    int64_t deadline_us;          // Reply deadline once sent
+    char *reply_buf;              // NULL if no reply is expected
+    size_t reply_size;
+    uint32_t timeout_ms;          // Reply timeout, 0 = WIZ_NET_REPLY_TIMEOUT_MS
+    esp_err_t *result;
+    SemaphoreHandle_t done;       // Given by the network task on completion
+    uint8_t requeues;             // Times the stack refused this datagram
+} wiz_net_req_t;
+
+// Per-class queueing delay statistics
+typedef struct {
+    uint32_t count;
+    uint64_t total_delay_us;
+    uint32_t max_delay_us;
+    uint32_t max_depth;           // Queue depth high-water mark
+} wiz_net_class_stats_t;
+
+// TX path statistics
+typedef struct {
+    uint32_t sent;
+    uint32_t bursts;              // Scheduler passes that sent more than one datagram
+    uint32_t max_burst;
+    uint32_t backpressure;        // sendto refused with ENOMEM/ENOBUFS/EAGAIN
+    uint32_t requeues;
+    uint32_t dropped;             // Refused more than WIZ_NET_MAX_REQUEUES times
+    uint32_t superseded;          // Reconcile sends dropped because a newer interactive send went out
+} wiz_net_tx_stats_t;
+
+// Bulb seen during discovery
+typedef struct {
+    char mac[WIZ_MAC_LEN];
+    char ip[16];
+} wiz_bulb_t;
+
+// Per-bulb scene state - dimming/temp of 0 leave the bulb's current value
+typedef struct {
+    char mac[WIZ_MAC_LEN];
+    bool on;
+    uint8_t dimming;   // 10-100 %
+    uint16_t temp;     // 2200-6500 K
+} wiz_scene_entry_t;
+
+typedef struct {
+    char name[WIZ_NAME_MAX];
+    uint8_t num_entries;
+    wiz_scene_entry_t entries[MAX_SCENE_BULBS];
+} wiz_scene_t;
+
+typedef struct {
+    char name[WIZ_NAME_MAX];
+    uint8_t num_bulbs;
+    char macs[MAX_SCENE_BULBS][WIZ_MAC_LEN];
+} wiz_group_t;
+
+// Tables as persisted in NVS - blobs of a different size, out-of-range contents
+// or a different WIZ_NVS_SCHEMA are discarded and replaced by the defaults
+typedef struct {
+    uint8_t num_scenes;
+    wiz_scene_t scenes[MAX_SCENES];
+} wiz_scene_table_t;
+
+typedef struct {
+    uint8_t num_groups;
+    wiz_group_t groups[MAX_GROUPS];
+} wiz_group_table_t;
+
+// Versioned desired state of one bulb, shared between controllers
+// Ordered by (version, origin) - the highest pair wins everywhere
+typedef struct {
+    char mac[WIZ_MAC_LEN];
+    bool on;
+    uint8_t dimming;
+    uint16_t temp;
+    uint32_t version;
+    uint32_t origin;   // Controller that made the change
+    bool applied;      // Sent successfully by this controller (only meaningful for the owner)
+} wiz_desired_t;
+
+// Another controller heard on the multicast group
+typedef struct {
+    uint32_t id;
+    int64_t last_seen_us;
+    int num_bulbs;
+    char bulbs[MAX_KNOWN_BULBS][WIZ_MAC_LEN];  // Bulbs the peer has discovered and can reach
+} wiz_peer_t;
+
+// Payloads and ack buffers for one multi-bulb burst
+typedef struct {
+    int count;
+    int handed;    // Bulbs owned by a peer controller, which sends them
+    int skipped;   // Bulbs not discovered by anyone
+    wiz_desired_t desired[MAX_SCENE_BULBS];
+    char ips[MAX_SCENE_BULBS][16];
+    char payloads[MAX_SCENE_BULBS][WIZ_PAYLOAD_MAX];
+    char acks[MAX_SCENE_BULBS][96];
+    esp_err_t results[MAX_SCENE_BULBS];
+    bool acked[MAX_SCENE_BULBS];
+} wiz_burst_t;
+
+// Outcome of the most recent scene or group apply, reported by the "stats" control command
+typedef struct {
+    char name[WIZ_NAME_MAX];
+    int acked;
+    int total;       // Bulbs this controller sent to, plus undiscovered ones
+    int handed;      // Sent by peer controllers
+    int64_t elapsed_ms;
+} wiz_apply_result_t;
+
+// Work handed from the coordination task to the control task: a control command,
+// or (root == NULL) a peer's state this controller owns and must send
+typedef struct {
+    cJSON *root;                 // Owned by the control task once queued
+    struct sockaddr_in from;     // Reply address
+    wiz_desired_t handoff;
+} wiz_control_msg_t;
+
 // Switch and Bulb Configuration Structure
 typedef struct {
     int gpio_pin;
@@ -36,8 +227,8 @@ typedef struct {
     const char* bulb_macs[MAX_BULBS_PER_SWITCH]; // MAC addresses for discovery
     int num_bulbs;
     bool last_state;
-    bool bulb_states[MAX_BULBS_PER_SWITCH];
     bool invert_logic;  // true = HIGH=ON LOW=OFF, false = LOW=ON HIGH=OFF
+    const char* scene_name;  // Optional scene: applied when switched ON, its bulbs turned off when OFF
 } switch_config_t;
 
 static const char *TAG = "wifi";
@@ -45,29 +236,120 @@ static const char *WIZ_TAG = "wiz";
 
 static int udp_socket = -1;
 static bool wifi_connected = false;
+static volatile bool udp_reinit_requested = false;  // Set on (re)connect, handled by wiz_net_task
 static TaskHandle_t button_task_handle = NULL;
 static bool sync_in_progress = false;  // Prevent concurrent sync operations
 
+// Network scheduler state - all udp_socket I/O happens in wiz_net_task
+static QueueHandle_t net_queues[WIZ_PRIO_COUNT];
+static SemaphoreHandle_t net_work_sem = NULL;
+static wiz_net_req_t net_pending[WIZ_NET_MAX_PENDING];
+static bool net_pending_used[WIZ_NET_MAX_PENDING];
+static int64_t discovery_until_us = 0;
+static wiz_net_class_stats_t net_stats[WIZ_PRIO_COUNT];
+static wiz_net_tx_stats_t net_tx_stats;
+static wiz_net_req_t net_held[WIZ_PRIO_COUNT];   // Refused datagram, retried before the queue
+static bool net_held_valid[WIZ_PRIO_COUNT];
+static int net_tx_capacity = WIZ_NET_TX_CAPACITY_INIT;
+static uint32_t net_next_id = 0;
+
+// Last flip or burst setPilot per bulb - a reconcile send queued before it is stale
+static struct {
+    char bulb_ip[16];
+    int64_t sent_us;
+} net_recent_interactive[WIZ_NET_RECENT_INTERACTIVE];
+static const char *net_prio_names[WIZ_PRIO_COUNT] = {"interactive", "burst", "reconcile", "discovery"};
+
+// Discovered bulbs, scenes and groups
+static wiz_bulb_t known_bulbs[MAX_KNOWN_BULBS];
+static int num_known_bulbs = 0;
+static wiz_scene_table_t scene_table;
+static wiz_group_table_t group_table;
+static wiz_burst_t burst;
+static wiz_apply_result_t last_apply;
+static SemaphoreHandle_t burst_mutex = NULL;
+static StaticSemaphore_t burst_mutex_buf;
+
+// Multi-controller coordination state - guarded by coord_mutex
+static int coord_socket = -1;
+static uint32_t controller_id = 0;
+static wiz_desired_t desired_table[MAX_DESIRED];
+static int num_desired = 0;
+static wiz_peer_t peers[MAX_PEERS];
+static int num_peers = 0;
+static uint32_t coord_clock = 0;        // Lamport clock - at least every version seen so far
+static int64_t coord_settle_us = 0;     // No reconcile before this; peers' state is still arriving
+static volatile bool coord_dump_requested = false;
+static SemaphoreHandle_t coord_mutex = NULL;
+static StaticSemaphore_t coord_mutex_buf;
+
+// Remote control commands
+static QueueHandle_t control_queue = NULL;
+
+// Default scenes and groups - written to NVS on first boot, edited copies persist
+static const wiz_scene_t default_scenes[] = {
+    {"evening", 6, {
+        {"444f8e26e756", true, 40, 2700},
+        {"444f8e26e796", true, 40, 2700},
+        {"d8a01162bc9e", true, 30, 2200},
+        {"d8a01162ba16", false, 0, 0},
+        {"444f8e308782", true, 60, 3000},
+        {"d8a01170b374", false, 0, 0},
+    }},
+    {"bright", 6, {
+        {"444f8e26e756", true, 100, 4200},
+        {"444f8e26e796", true, 100, 4200},
+        {"d8a01162bc9e", true, 100, 4200},
+        {"d8a01162ba16", true, 100, 4200},
+        {"444f8e308782", true, 100, 4200},
+        {"d8a01170b374", true, 100, 4200},
+    }},
+};
+
+static const wiz_group_t default_groups[] = {
+    {"all", 6, {"444f8e26e756", "444f8e26e796", "d8a01162bc9e",
+                "d8a01162ba16", "444f8e308782", "d8a01170b374"}},
+};
+
 // Switch configurations - Switch 1 controls bulbs 2&7 together
 // Switch 1: LOW=ON HIGH=OFF (invert_logic=false)
 // Switches 2-5: HIGH=ON LOW=OFF (invert_logic=true) - inverted logic
 // Note: IPs are discovered via MAC address at startup
 static switch_config_t switches[NUM_SWITCHES] = {
-    {SWITCH_GPIO_1, {"", ""}, {"444f8e26e756","444f8e26e796"}, 2, -1, {false, false}, false},  // Switch 1: Bulbs 2 & 7 (MACs)
-    {SWITCH_GPIO_2, {""}, {"d8a01162bc9e"}, 1, -1, {false}, true},                               // Switch 2: Bulb 4 (MAC)
-    {SWITCH_GPIO_3, {""}, {"d8a01162ba16"}, 1, -1, {false}, true},                               // Switch 3: Bulb 5 (MAC)
-    {SWITCH_GPIO_4, {""}, {"444f8e308782"}, 1, -1, {false}, true},                               // Switch 4: Bulb 6 (MAC)
-    {SWITCH_GPIO_5, {""}, {"d8a01170b374"}, 1, -1, {false}, true}                                // Switch 5: Bulb 3 (MAC)
+    {SWITCH_GPIO_1, {"", ""}, {"444f8e26e756","444f8e26e796"}, 2, -1, false},  // Switch 1: Bulbs 2 & 7 (MACs)
+    {SWITCH_GPIO_2, {""}, {"d8a01162bc9e"}, 1, -1, true},                       // Switch 2: Bulb 4 (MAC)
+    {SWITCH_GPIO_3, {""}, {"d8a01162ba16"}, 1, -1, true},                       // Switch 3: Bulb 5 (MAC)
+    {SWITCH_GPIO_4, {""}, {"444f8e308782"}, 1, -1, true},                       // Switch 4: Bulb 6 (MAC)
+    {SWITCH_GPIO_5, {""}, {"d8a01170b374"}, 1, -1, true}                        // Switch 5: Bulb 3 (MAC)
 };
 
 // Forward declarations
 esp_err_t wiz_udp_init(void);
 esp_err_t wiz_send_command(const char *bulb_ip, const char *json_command);
-esp_err_t wiz_receive_response(char *buffer, size_t buffer_size);
+esp_err_t wiz_net_init(void);
+esp_err_t wiz_net_submit(wiz_prio_t prio, const char *bulb_ip, const char *json_command,
+                         char *reply_buf, size_t reply_size);
+void wiz_net_log_stats(void);
 esp_err_t wiz_get_pilot(const char *bulb_ip, char *response_buffer, size_t buffer_size);
-esp_err_t wiz_set_state(const char *bulb_ip, bool on);
+esp_err_t wiz_set_pilot(const char *bulb_ip, bool on, uint8_t dimming, uint16_t temp, wiz_prio_t prio);
+esp_err_t wiz_set_state(const char *bulb_ip, bool on, wiz_prio_t prio);
 esp_err_t wiz_discover_and_test(const char *bulb_ip);
 void wiz_discover_bulbs(void);
+esp_err_t wiz_coord_init(void);
+void wiz_coord_seed(const char *mac, bool on);
+bool wiz_coord_publish(const char *mac, bool on, uint8_t dimming, uint16_t temp, wiz_desired_t *out);
+void wiz_coord_mark_applied(const wiz_desired_t *entry);
+bool wiz_coord_unapplied(int index, wiz_desired_t *out);
+bool wiz_coord_is_current(const wiz_desired_t *entry);
+bool wiz_coord_settled(void);
+void wiz_scenes_init(void);
+esp_err_t wiz_scene_store(const wiz_scene_t *scene);
+esp_err_t wiz_group_store(const wiz_group_t *group);
+esp_err_t wiz_scene_apply(const char *name, bool activate, wiz_prio_t prio, wiz_apply_result_t *result);
+esp_err_t wiz_group_set_state(const char *name, bool on, wiz_prio_t prio, wiz_apply_result_t *result);
+esp_err_t wiz_control_init(void);
+void wiz_control_submit(cJSON *root, const struct sockaddr_in *from);
+void wiz_control_handoff(const wiz_desired_t *entry);
 void toggle_gpio_init(void);
 void led_status_init(void);
 void led_status_blink(uint32_t count, uint32_t delay_ms);
@@ -87,8 +369,11 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "Got IP: %s", ip4addr_ntoa((ip4_addr_t*)&event->ip_info.ip));
         wifi_connected = true;
-        // Initialize UDP socket for WiZ communication
-        wiz_udp_init();
+        // (Re)create the UDP socket from the network task, which owns it
+        udp_reinit_requested = true;
+        if (net_work_sem) {
+            xSemaphoreGive(net_work_sem);
+        }
     }
 }
 
@@ -129,252 +414,2144 @@ void wifi_init(void)
     ESP_ERROR_CHECK(esp_wifi_start());
 }
 
-// ========== WiZ Bulb UDP Communication Functions ==========
+// ========== WiZ Bulb UDP Communication Functions ==========
+
+/**
+ * Initialize UDP socket for WiZ bulb communication
+ * Only called from the network task - the event handler posts a reinit request
+ */
+esp_err_t wiz_udp_init(void)
+{
+    if (udp_socket >= 0) {
+        close(udp_socket);
+    }
+
+    udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp_socket < 0) {
+        ESP_LOGE(WIZ_TAG, "Failed to create UDP socket");
+        return ESP_FAIL;
+    }
+
+    // Discovery broadcasts share this socket so replies are demultiplexed in one place
+    int broadcast = 1;
+    if (setsockopt(udp_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
+        ESP_LOGW(WIZ_TAG, "Failed to enable broadcast on UDP socket");
+    }
+
+    ESP_LOGI(WIZ_TAG, "UDP socket initialized");
+    return ESP_OK;
+}
+
+#if WIZ_NET_TXQ_SLOTS > 0
+/**
+ * Emulated TX queue for fault injection - true if a datagram fits right now
+ * Fill level is kept in millionths of a datagram so the drain needs no floats.
+ */
+static bool wiz_txq_admit(void)
+{
+    static int64_t level = 0;
+    static int64_t last_us = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    level -= (now_us - last_us) * WIZ_NET_TXQ_RATE;
+    if (level < 0) {
+        level = 0;
+    }
+    last_us = now_us;
+
+    if (level + 1000000 > (int64_t)WIZ_NET_TXQ_SLOTS * 1000000) {
+        return false;
+    }
+    level += 1000000;
+    return true;
+}
+#endif
+
+/**
+ * Send JSON command to WiZ bulb via UDP
+ * Only called from the network task - use wiz_net_submit() from elsewhere
+ * Returns ESP_ERR_NO_MEM when the stack is out of TX buffers, so the caller can requeue.
+ */
+esp_err_t wiz_send_command(const char *bulb_ip, const char *json_command)
+{
+    if (udp_socket < 0) {
+        ESP_LOGE(WIZ_TAG, "UDP socket not initialized");
+        return ESP_FAIL;
+    }
+
+    if (!wifi_connected) {
+        ESP_LOGE(WIZ_TAG, "WiFi not connected");
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in dest_addr;
+    dest_addr.sin_addr.s_addr = inet_addr(bulb_ip);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(WIZ_PORT);
+
+#if WIZ_NET_TXQ_SLOTS > 0
+    if (!wiz_txq_admit()) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    int len = strlen(json_command);
+    int err = sendto(udp_socket, json_command, len, 0,
+                     (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+
+    if (err < 0) {
+        if (errno == ENOMEM || errno == ENOBUFS || errno == EAGAIN || errno == EWOULDBLOCK) {
+            return ESP_ERR_NO_MEM;
+        }
+        ESP_LOGE(WIZ_TAG, "Error occurred during sending: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(WIZ_TAG, "Sent to %s: %s", bulb_ip, json_command);
+    return ESP_OK;
+}
+
+// ========== Prioritised Network Scheduler ==========
+
+/**
+ * Signal completion of a request to the task that submitted it
+ */
+static void wiz_net_complete(wiz_net_req_t *req, esp_err_t result)
+{
+    if (req->result) {
+        *req->result = result;
+    }
+    if (req->done) {
+        xSemaphoreGive(req->done);
+    }
+}
+
+/**
+ * Record how long a request sat in its class queue before going out
+ */
+static void wiz_net_record_delay(const wiz_net_req_t *req, int64_t now_us)
+{
+    wiz_net_class_stats_t *st = &net_stats[req->prio];
+    uint32_t delay_us = (uint32_t)(now_us - req->enqueue_us);
+
+    st->count++;
+    st->total_delay_us += delay_us;
+    if (delay_us > st->max_delay_us) {
+        st->max_delay_us = delay_us;
+    }
+}
+
+/**
+ * Log per-class queueing delay so flips can be checked against housekeeping,
+ * plus TX pacing counters and the sustained send rate since the last report
+ */
+void wiz_net_log_stats(void)
+{
+    static uint32_t last_sent = 0;
+    static int64_t last_us = 0;
+
+    for (int p = 0; p < WIZ_PRIO_COUNT; p++) {
+        const wiz_net_class_stats_t *st = &net_stats[p];
+        uint32_t avg_us = st->count ? (uint32_t)(st->total_delay_us / st->count) : 0;
+        ESP_LOGI(WIZ_TAG, "Queue delay %-11s: n=%lu avg=%lu us max=%lu us (queued %u, peak %lu)",
+                 net_prio_names[p], (unsigned long)st->count, (unsigned long)avg_us,
+                 (unsigned long)st->max_delay_us, (unsigned)uxQueueMessagesWaiting(net_queues[p]),
+                 (unsigned long)st->max_depth);
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t rate = 0;
+    if (last_us > 0 && now_us > last_us) {
+        rate = (uint32_t)((uint64_t)(net_tx_stats.sent - last_sent) * 1000000 / (uint64_t)(now_us - last_us));
+    }
+    last_sent = net_tx_stats.sent;
+    last_us = now_us;
+
+    const wiz_net_tx_stats_t *tx = &net_tx_stats;
+    ESP_LOGI(WIZ_TAG, "TX: sent=%lu (%lu/s) bursts=%lu max_burst=%lu backpressure=%lu requeued=%lu dropped=%lu superseded=%lu capacity=%d/%dms",
+             (unsigned long)tx->sent, (unsigned long)rate, (unsigned long)tx->bursts,
+             (unsigned long)tx->max_burst, (unsigned long)tx->backpressure, (unsigned long)tx->requeues,
+             (unsigned long)tx->dropped, (unsigned long)tx->superseded, net_tx_capacity, WIZ_NET_BUDGET_WINDOW_MS);
+}
+
+static int wiz_net_free_pending_slot(void)
+{
+    for (int i = 0; i < WIZ_NET_MAX_PENDING; i++) {
+        if (!net_pending_used[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int wiz_net_pending_count(void)
+{
+    int count = 0;
+    for (int i = 0; i < WIZ_NET_MAX_PENDING; i++) {
+        if (net_pending_used[i]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Remember when a flip or burst setPilot went out to a bulb
+ */
+static void wiz_net_note_interactive(const wiz_net_req_t *req, int64_t now_us)
+{
+    int slot = 0;
+    for (int i = 0; i < WIZ_NET_RECENT_INTERACTIVE; i++) {
+        if (strcmp(net_recent_interactive[i].bulb_ip, req->bulb_ip) == 0) {
+            slot = i;
+            break;
+        }
+        if (net_recent_interactive[i].sent_us < net_recent_interactive[slot].sent_us) {
+            slot = i;
+        }
+    }
+    strncpy(net_recent_interactive[slot].bulb_ip, req->bulb_ip, sizeof(net_recent_interactive[slot].bulb_ip) - 1);
+    net_recent_interactive[slot].sent_us = now_us;
+}
+
+/**
+ * A reconcile setPilot queued before a flip or burst send to the same bulb would
+ * undo the newer state if it went out now
+ */
+static bool wiz_net_superseded(const wiz_net_req_t *req)
+{
+    if (req->prio != WIZ_PRIO_RECONCILE || strcmp(req->method, "setPilot") != 0) {
+        return false;
+    }
+    for (int i = 0; i < WIZ_NET_RECENT_INTERACTIVE; i++) {
+        if (strcmp(net_recent_interactive[i].bulb_ip, req->bulb_ip) == 0) {
+            return net_recent_interactive[i].sent_us >= req->enqueue_us;
+        }
+    }
+    return false;
+}
+
+/**
+ * Send one request; requests that expect a reply are parked in the pending table
+ * Every datagram gets a fresh id so a late ack to an earlier send to the same bulb
+ * cannot complete this request.
+ * Returns false if the stack refused the datagram and the request must be requeued.
+ */
+static bool wiz_net_dispatch(wiz_net_req_t *req, int64_t now_us)
+{
+    char datagram[WIZ_PAYLOAD_MAX + 16];
+    req->id = ++net_next_id;
+    if (req->payload[0] == '{') {
+        snprintf(datagram, sizeof(datagram), "{\"id\":%lu,%s", (unsigned long)req->id, req->payload + 1);
+    } else {
+        snprintf(datagram, sizeof(datagram), "%s", req->payload);
+    }
+
+    esp_err_t ret = wiz_send_command(req->bulb_ip, datagram);
+    if (ret == ESP_ERR_NO_MEM) {
+        net_tx_stats.backpressure++;
+        if (++req->requeues > WIZ_NET_MAX_REQUEUES) {
+            ESP_LOGE(WIZ_TAG, "Dropping command to %s after %d refused sends", req->bulb_ip, WIZ_NET_MAX_REQUEUES);
+            net_tx_stats.dropped++;
+            wiz_net_complete(req, ESP_FAIL);
+            return true;
+        }
+        net_tx_stats.requeues++;
+        return false;
+    }
+
+    wiz_net_record_delay(req, now_us);
+    if (ret == ESP_OK) {
+        net_tx_stats.sent++;
+        if (req->prio < WIZ_PRIO_RECONCILE && strcmp(req->method, "setPilot") == 0) {
+            wiz_net_note_interactive(req, now_us);
+        }
+    }
+
+    if (ret == ESP_OK && req->prio == WIZ_PRIO_DISCOVERY && strcmp(req->bulb_ip, WIZ_BROADCAST_IP) == 0) {
+        discovery_until_us = now_us + (int64_t)WIZ_DISCOVERY_WINDOW_MS * 1000;
+    }
+
+    if (ret != ESP_OK || req->reply_buf == NULL) {
+        wiz_net_complete(req, ret);
+        return true;
+    }
+
+    int slot = wiz_net_free_pending_slot();
+    if (slot < 0) {
+        // Background traffic is capped below the table size, so only a flood of interactive acks gets here
+        ESP_LOGW(WIZ_TAG, "No pending slot for reply from %s", req->bulb_ip);
+        wiz_net_complete(req, ESP_FAIL);
+        return true;
+    }
+
+    uint32_t timeout_ms = req->timeout_ms ? req->timeout_ms : WIZ_NET_REPLY_TIMEOUT_MS;
+    req->deadline_us = now_us + (int64_t)timeout_ms * 1000;
+    net_pending[slot] = *req;
+    net_pending_used[slot] = true;
+    return true;
+}
+
+/**
+ * Next request of a class - a datagram refused by the stack goes out first
+ */
+static bool wiz_net_next(int prio, wiz_net_req_t *req)
+{
+    if (net_held_valid[prio]) {
+        *req = net_held[prio];
+        net_held_valid[prio] = false;
+        return true;
+    }
+    return xQueueReceive(net_queues[prio], req, 0) == pdTRUE;
+}
+
+static uint32_t wiz_net_depth(int prio)
+{
+    return uxQueueMessagesWaiting(net_queues[prio]) + (net_held_valid[prio] ? 1 : 0);
+}
+
+/**
+ * Match a received datagram to its pending request
+ * A reply that echoes an id only matches the request sent with it; one without
+ * falls back to the oldest pending request for the same bulb and method.
+ */
+static int wiz_net_match_pending(const char *ip_str, const char *method, const cJSON *id)
+{
+    int match = -1;
+    for (int i = 0; i < WIZ_NET_MAX_PENDING; i++) {
+        if (!net_pending_used[i] || strcmp(net_pending[i].bulb_ip, ip_str) != 0) {
+            continue;
+        }
+        if (id && cJSON_IsNumber(id)) {
+            if ((uint32_t)id->valuedouble == net_pending[i].id) {
+                return i;
+            }
+            continue;
+        }
+        if (method && strcmp(net_pending[i].method, method) != 0) {
+            continue;
+        }
+        if (match < 0 || net_pending[i].deadline_us < net_pending[match].deadline_us) {
+            match = i;
+        }
+    }
+    return match;
+}
+
+/**
+ * Remember a discovered bulb so scenes and groups can address it by MAC
+ */
+static void wiz_known_bulb_update(const char *mac, const char *ip_str)
+{
+    for (int i = 0; i < num_known_bulbs; i++) {
+        if (strcmp(known_bulbs[i].mac, mac) == 0) {
+            strncpy(known_bulbs[i].ip, ip_str, sizeof(known_bulbs[i].ip) - 1);
+            return;
+        }
+    }
+
+    if (num_known_bulbs >= MAX_KNOWN_BULBS) {
+        ESP_LOGW(WIZ_TAG, "Known bulb table full, ignoring %s", mac);
+        return;
+    }
+
+    wiz_bulb_t *bulb = &known_bulbs[num_known_bulbs++];
+    strncpy(bulb->mac, mac, sizeof(bulb->mac) - 1);
+    strncpy(bulb->ip, ip_str, sizeof(bulb->ip) - 1);
+}
+
+/**
+ * Look up a bulb's IP by MAC from discovery results
+ */
+static const char *wiz_lookup_bulb_ip(const char *mac)
+{
+    for (int i = 0; i < num_known_bulbs; i++) {
+        if (strcmp(known_bulbs[i].mac, mac) == 0 && known_bulbs[i].ip[0] != '\0') {
+            return known_bulbs[i].ip;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Update configured bulb IPs from a discovery reply
+ */
+static void wiz_handle_discovery_reply(const cJSON *root, const char *ip_str)
+{
+    cJSON *result = cJSON_GetObjectItem(root, "result");
+    if (!result) {
+        return;
+    }
+
+    cJSON *mac_item = cJSON_GetObjectItem(result, "mac");
+    if (!mac_item || !cJSON_IsString(mac_item)) {
+        return;
+    }
+
+    const char *mac = mac_item->valuestring;
+    wiz_known_bulb_update(mac, ip_str);
+
+    // Check if this MAC matches any of our configured bulbs
+    for (int i = 0; i < NUM_SWITCHES; i++) {
+        for (int j = 0; j < switches[i].num_bulbs; j++) {
+            if (switches[i].bulb_macs[j] && strcmp(mac, switches[i].bulb_macs[j]) == 0) {
+                ESP_LOGI(WIZ_TAG, "Found configured bulb! MAC: %s, IP: %s (Switch %d)",
+                         mac, ip_str, i + 1);
+                strncpy(switches[i].bulb_ips[j], ip_str, sizeof(switches[i].bulb_ips[j]) - 1);
+            }
+        }
+    }
+}
+
+/**
+ * Drain all datagrams waiting on the socket and route each to its owner
+ */
+static void wiz_net_poll_rx(int64_t now_us)
+{
+    static char rx_buffer[1024];
+
+    while (udp_socket >= 0) {
+        struct sockaddr_in source_addr;
+        socklen_t socklen = sizeof(source_addr);
+        int len = recvfrom(udp_socket, rx_buffer, sizeof(rx_buffer) - 1, MSG_DONTWAIT,
+                           (struct sockaddr *)&source_addr, &socklen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGE(WIZ_TAG, "recvfrom failed: errno %d", errno);
+            }
+            return;
+        }
+        rx_buffer[len] = '\0';
+
+        char ip_str[16];
+        inet_ntoa_r(source_addr.sin_addr, ip_str, sizeof(ip_str));
+
+        cJSON *root = cJSON_Parse(rx_buffer);
+        cJSON *method_item = root ? cJSON_GetObjectItem(root, "method") : NULL;
+        const char *method = (method_item && cJSON_IsString(method_item)) ? method_item->valuestring : NULL;
+
+        cJSON *id_item = root ? cJSON_GetObjectItem(root, "id") : NULL;
+        int slot = wiz_net_match_pending(ip_str, method, id_item);
+        if (slot >= 0) {
+            wiz_net_req_t *req = &net_pending[slot];
+            ESP_LOGI(WIZ_TAG, "Received from %s: %s", ip_str, rx_buffer);
+            strncpy(req->reply_buf, rx_buffer, req->reply_size - 1);
+            req->reply_buf[req->reply_size - 1] = '\0';
+            net_pending_used[slot] = false;
+            wiz_net_complete(req, ESP_OK);
+        } else if (root && now_us < discovery_until_us) {
+            wiz_handle_discovery_reply(root, ip_str);
+        } else {
+            // setPilot acks and stray replies - never handed to an unrelated caller
+            ESP_LOGD(WIZ_TAG, "Dropped unsolicited reply from %s: %s", ip_str, rx_buffer);
+        }
+
+        if (root) {
+            cJSON_Delete(root);
+        }
+    }
+}
+
+/**
+ * Fail pending requests whose reply deadline has passed
+ */
+static void wiz_net_expire_pending(int64_t now_us)
+{
+    for (int i = 0; i < WIZ_NET_MAX_PENDING; i++) {
+        if (net_pending_used[i] && now_us >= net_pending[i].deadline_us) {
+            ESP_LOGW(WIZ_TAG, "No response received from %s (timeout)", net_pending[i].bulb_ip);
+            net_pending_used[i] = false;
+            wiz_net_complete(&net_pending[i], ESP_FAIL);
+        }
+    }
+}
+
+/**
+ * Network task - sole owner of udp_socket
+ * Single flips are sent ahead of everything else and never wait for the budget.
+ * Bursts, then reconcile and discovery traffic, go out within the TX budget, so a
+ * 30-bulb scene is paced instead of hammering the stack until it refuses.
+ * The budget refills at net_tx_capacity datagrams per window, spread evenly: at
+ * most one poll period's worth goes out back to back, so a shallow TX queue is
+ * not overrun at the start of every window. Capacity tracks what the stack takes:
+ * it is halved whenever the stack refuses a datagram and grows by one for every
+ * window in which traffic waited for budget without a refusal.
+ */
+static void wiz_net_task(void *pvParameters)
+{
+    int64_t window_start_us = esp_timer_get_time();
+    int64_t last_stats_us = window_start_us;
+    int64_t backoff_until_us = 0;              // Background classes
+    int64_t interactive_backoff_until_us = 0;  // Set only when an interactive send is refused
+    int64_t last_refill_us = window_start_us;
+    int64_t budget = WIZ_NET_CREDIT;           // Millionths of a datagram; flips may overdraw it
+    bool window_refused = false;
+    bool window_starved = false;               // Paced traffic waited for budget this window
+    bool backlog = false;
+
+    ESP_LOGI(WIZ_TAG, "Network scheduler task started");
+
+    while (1) {
+        // Sleep until work arrives, but keep polling while replies or background work are outstanding
+        bool busy = backlog || wiz_net_pending_count() > 0 || esp_timer_get_time() < discovery_until_us;
+        xSemaphoreTake(net_work_sem, busy ? pdMS_TO_TICKS(WIZ_NET_POLL_MS) : portMAX_DELAY);
+
+        if (udp_reinit_requested) {
+            udp_reinit_requested = false;
+            // Replies to requests sent on the old socket can no longer arrive
+            for (int i = 0; i < WIZ_NET_MAX_PENDING; i++) {
+                if (net_pending_used[i]) {
+                    net_pending_used[i] = false;
+                    wiz_net_complete(&net_pending[i], ESP_FAIL);
+                }
+            }
+            wiz_udp_init();
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - window_start_us >= (int64_t)WIZ_NET_BUDGET_WINDOW_MS * 1000) {
+            // Additive increase once a window was budget-limited without the stack pushing back
+            if (!window_refused && window_starved && net_tx_capacity < WIZ_NET_TX_CAPACITY_MAX) {
+                net_tx_capacity++;
+            }
+            window_start_us = now_us;
+            window_refused = false;
+            window_starved = false;
+        }
+
+        // Refill at net_tx_capacity per window, holding at most one poll period's worth
+        int64_t max_budget = (int64_t)net_tx_capacity * WIZ_NET_POLL_MS / WIZ_NET_BUDGET_WINDOW_MS;
+        max_budget = (max_budget > 1 ? max_budget : 1) * WIZ_NET_CREDIT;
+        budget += (now_us - last_refill_us) * net_tx_capacity * (WIZ_NET_CREDIT / 1000) / WIZ_NET_BUDGET_WINDOW_MS;
+        if (budget > max_budget) {
+            budget = max_budget;
+        }
+        last_refill_us = now_us;
+
+        for (int p = 0; p < WIZ_PRIO_COUNT; p++) {
+            uint32_t depth = wiz_net_depth(p);
+            if (depth > net_stats[p].max_depth) {
+                net_stats[p].max_depth = depth;
+            }
+        }
+
+        // A flip is never held back by the budget - it only uses it up,
+        // so the paced classes get whatever the flip left over
+        int sent = 0;
+        bool refused = false;
+        bool interactive_refused = false;
+        wiz_net_req_t req;
+        while (now_us >= interactive_backoff_until_us && wiz_net_next(WIZ_PRIO_INTERACTIVE, &req)) {
+            if (!wiz_net_dispatch(&req, esp_timer_get_time())) {
+                net_held[WIZ_PRIO_INTERACTIVE] = req;
+                net_held_valid[WIZ_PRIO_INTERACTIVE] = true;
+                refused = true;
+                interactive_refused = true;
+                break;
+            }
+            budget -= WIZ_NET_CREDIT;
+            sent++;
+        }
+
+        for (int p = WIZ_PRIO_INTERACTIVE + 1; p < WIZ_PRIO_COUNT && !refused && now_us >= backoff_until_us; p++) {
+            // A burst collects every ack at once; background classes leave room for it
+            int max_pending = p == WIZ_PRIO_BURST ? WIZ_NET_MAX_PENDING : WIZ_NET_BG_MAX_PENDING;
+            while (budget >= WIZ_NET_CREDIT &&
+                   wiz_net_depth(WIZ_PRIO_INTERACTIVE) == 0 &&
+                   wiz_net_pending_count() < max_pending &&
+                   wiz_net_next(p, &req)) {
+                if (wiz_net_superseded(&req)) {
+                    net_tx_stats.superseded++;
+                    wiz_net_complete(&req, ESP_ERR_INVALID_STATE);
+                    continue;
+                }
+                if (!wiz_net_dispatch(&req, esp_timer_get_time())) {
+                    // Out of TX buffers - hold the datagram instead of failing it
+                    net_held[p] = req;
+                    net_held_valid[p] = true;
+                    refused = true;
+                    break;
+                }
+                budget -= WIZ_NET_CREDIT;
+                sent++;
+            }
+        }
+
+        if (budget < WIZ_NET_CREDIT) {
+            for (int p = WIZ_PRIO_INTERACTIVE + 1; p < WIZ_PRIO_COUNT; p++) {
+                if (wiz_net_depth(p) > 0) {
+                    window_starved = true;
+                }
+            }
+        }
+
+        if (refused) {
+            // Multiplicative decrease and a short pause to let the TX queue drain
+            net_tx_capacity = net_tx_capacity / 2 > WIZ_NET_TX_CAPACITY_MIN ?
+                              net_tx_capacity / 2 : WIZ_NET_TX_CAPACITY_MIN;
+            budget = 0;
+            window_refused = true;
+            backoff_until_us = esp_timer_get_time() + (int64_t)WIZ_NET_BACKOFF_MS * 1000;
+            if (interactive_refused) {
+                interactive_backoff_until_us = backoff_until_us;
+            }
+        }
+
+        if (sent > 1) {
+            net_tx_stats.bursts++;
+            if ((uint32_t)sent > net_tx_stats.max_burst) {
+                net_tx_stats.max_burst = sent;
+            }
+        }
+
+        backlog = false;
+        for (int p = 0; p < WIZ_PRIO_COUNT; p++) {
+            if (wiz_net_depth(p) > 0) {
+                backlog = true;
+            }
+        }
+
+        now_us = esp_timer_get_time();
+        wiz_net_poll_rx(now_us);
+        wiz_net_expire_pending(now_us);
+
+        if (now_us - last_stats_us >= (int64_t)WIZ_NET_STATS_INTERVAL_MS * 1000) {
+            wiz_net_log_stats();
+            last_stats_us = now_us;
+        }
+    }
+}
+
+/**
+ * Create the per-class queues and start the network task
+ */
+esp_err_t wiz_net_init(void)
+{
+    for (int p = 0; p < WIZ_PRIO_COUNT; p++) {
+        net_queues[p] = xQueueCreate(WIZ_NET_QUEUE_DEPTH, sizeof(wiz_net_req_t));
+        if (net_queues[p] == NULL) {
+            ESP_LOGE(WIZ_TAG, "Failed to create %s queue", net_prio_names[p]);
+            return ESP_FAIL;
+        }
+    }
+
+    net_work_sem = xSemaphoreCreateCounting(WIZ_NET_QUEUE_DEPTH * WIZ_PRIO_COUNT, 0);
+    if (net_work_sem == NULL) {
+        ESP_LOGE(WIZ_TAG, "Failed to create network work semaphore");
+        return ESP_FAIL;
+    }
+
+    // Above the toggle handler so interactive sends go out as soon as they are queued
+    if (xTaskCreate(wiz_net_task, "wiz_net", 6144, NULL, 12, NULL) != pdPASS) {
+        ESP_LOGE(WIZ_TAG, "Failed to create network task");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Queue a command on the given traffic class without waiting for it
+ * done is given once the request completes and *result holds the outcome.
+ * Set kick to false when queueing a burst, then call wiz_net_kick() once.
+ */
+static esp_err_t wiz_net_enqueue(wiz_prio_t prio, const char *bulb_ip, const char *json_command,
+                                 char *reply_buf, size_t reply_size, uint32_t timeout_ms,
+                                 SemaphoreHandle_t done, esp_err_t *result, bool kick)
+{
+    if (net_work_sem == NULL || prio >= WIZ_PRIO_COUNT) {
+        return ESP_FAIL;
+    }
+
+    if (strlen(json_command) >= WIZ_PAYLOAD_MAX) {
+        ESP_LOGE(WIZ_TAG, "Command too long for %s", bulb_ip);
+        return ESP_FAIL;
+    }
+
+    // The socket may broadcast for discovery - an empty or unresolved bulb IP
+    // parses as 255.255.255.255 and would switch every bulb on the LAN
+    if (prio != WIZ_PRIO_DISCOVERY &&
+        (inet_addr(bulb_ip) == INADDR_NONE || strcmp(bulb_ip, WIZ_BROADCAST_IP) == 0)) {
+        ESP_LOGE(WIZ_TAG, "Refusing to send to '%s' outside discovery", bulb_ip);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    wiz_net_req_t req = {0};
+    req.prio = prio;
+    strncpy(req.bulb_ip, bulb_ip, sizeof(req.bulb_ip) - 1);
+    strncpy(req.payload, json_command, sizeof(req.payload) - 1);
+    req.reply_buf = (reply_buf && reply_size > 0) ? reply_buf : NULL;
+    req.reply_size = reply_size;
+    req.timeout_ms = timeout_ms;
+
+    cJSON *cmd = cJSON_Parse(json_command);
+    cJSON *method_item = cmd ? cJSON_GetObjectItem(cmd, "method") : NULL;
+    if (method_item && cJSON_IsString(method_item)) {
+        strncpy(req.method, method_item->valuestring, sizeof(req.method) - 1);
+    }
+    if (cmd) {
+        cJSON_Delete(cmd);
+    }
+
+    req.done = done;
+    req.result = result;
+    req.enqueue_us = esp_timer_get_time();
+
+    if (xQueueSend(net_queues[prio], &req, 0) != pdTRUE) {
+        // Queue full - wake the network task so it drains, then wait for room
+        xSemaphoreGive(net_work_sem);
+        if (xQueueSend(net_queues[prio], &req, portMAX_DELAY) != pdTRUE) {
+            return ESP_FAIL;
+        }
+    }
+    if (kick) {
+        xSemaphoreGive(net_work_sem);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Wake the network task after a burst has been queued
+ */
+static void wiz_net_kick(void)
+{
+    xSemaphoreGive(net_work_sem);
+}
+
+/**
+ * Queue a command on the given traffic class and block until it has been sent
+ * (or, if reply_buf is given, until the matching reply arrives or times out)
+ */
+esp_err_t wiz_net_submit(wiz_prio_t prio, const char *bulb_ip, const char *json_command,
+                         char *reply_buf, size_t reply_size)
+{
+    // The network task always completes the request, so waiting forever is safe
+    StaticSemaphore_t done_buf;
+    SemaphoreHandle_t done = xSemaphoreCreateBinaryStatic(&done_buf);
+    esp_err_t result = ESP_FAIL;
+
+    esp_err_t ret = wiz_net_enqueue(prio, bulb_ip, json_command, reply_buf, reply_size, 0,
+                                    done, &result, true);
+    if (ret != ESP_OK) {
+        vSemaphoreDelete(done);
+        return ret;
+    }
+
+    xSemaphoreTake(done, portMAX_DELAY);
+    vSemaphoreDelete(done);
+    return result;
+}
+
+/**
+ * Get current WiZ bulb state (discovery/test function)
+ */
+esp_err_t wiz_get_pilot(const char *bulb_ip, char *response_buffer, size_t buffer_size)
+{
+    const char *json_cmd = "{\"method\":\"getPilot\",\"params\":{}}";
+
+    return wiz_net_submit(WIZ_PRIO_DISCOVERY, bulb_ip, json_cmd, response_buffer, buffer_size);
+}
+
+/**
+ * Build a setPilot payload; dimming/temp of 0 are left out
+ */
+static void wiz_build_pilot(char *buf, size_t size, bool on, uint8_t dimming, uint16_t temp)
+{
+    if (!on) {
+        snprintf(buf, size, "{\"method\":\"setPilot\",\"params\":{\"state\":false}}");
+    } else if (dimming && temp) {
+        snprintf(buf, size, "{\"method\":\"setPilot\",\"params\":{\"state\":true,\"dimming\":%u,\"temp\":%u}}",
+                 dimming, temp);
+    } else if (dimming) {
+        snprintf(buf, size, "{\"method\":\"setPilot\",\"params\":{\"state\":true,\"dimming\":%u}}", dimming);
+    } else if (temp) {
+        snprintf(buf, size, "{\"method\":\"setPilot\",\"params\":{\"state\":true,\"temp\":%u}}", temp);
+    } else {
+        snprintf(buf, size, "{\"method\":\"setPilot\",\"params\":{\"state\":true}}");
+    }
+}
+
+/**
+ * Set WiZ bulb state, brightness and colour temperature with retry logic
+ * TX backpressure is absorbed by the network task, so retries only cover hard failures
+ */
+esp_err_t wiz_set_pilot(const char *bulb_ip, bool on, uint8_t dimming, uint16_t temp, wiz_prio_t prio)
+{
+    char json_cmd[WIZ_PAYLOAD_MAX];
+    wiz_build_pilot(json_cmd, sizeof(json_cmd), on, dimming, temp);
+    
+    const int MAX_RETRIES = 3;
+    const int RETRY_DELAY_MS = 200;
+    
+    for (int attempt = 0; attempt < MAX_RETRIES; attempt++) {
+        esp_err_t ret = wiz_net_submit(prio, bulb_ip, json_cmd, NULL, 0);
+        if (ret == ESP_OK) {
+            if (attempt > 0) {
+                ESP_LOGW(WIZ_TAG, "Bulb command succeeded on attempt %d", attempt + 1);
+            }
+            return ESP_OK;
+        }
+        if (ret == ESP_ERR_INVALID_STATE || ret == ESP_ERR_INVALID_ARG) {
+            return ret;  // Superseded by a newer interactive command, or no valid address - nothing to retry
+        }
+        
+        if (attempt < MAX_RETRIES - 1) {
+            ESP_LOGW(WIZ_TAG, "Bulb command failed, retrying in %dms (attempt %d/%d)", 
+                     RETRY_DELAY_MS, attempt + 1, MAX_RETRIES);
+            vTaskDelay(pdMS_TO_TICKS(RETRY_DELAY_MS));
+        }
+    }
+    
+    ESP_LOGE(WIZ_TAG, "Failed to set bulb state after %d attempts", MAX_RETRIES);
+    return ESP_FAIL;
+}
+
+/**
+ * Turn WiZ bulb on or off with retry logic
+ */
+esp_err_t wiz_set_state(const char *bulb_ip, bool on, wiz_prio_t prio)
+{
+    return wiz_set_pilot(bulb_ip, on, 0, 0, prio);
+}
+
+/**
+ * Discover and test communication with WiZ bulb
+ */
+esp_err_t wiz_discover_and_test(const char *bulb_ip)
+{
+    ESP_LOGI(WIZ_TAG, "========================================");
+    ESP_LOGI(WIZ_TAG, "Testing communication with bulb: %s", bulb_ip);
+    ESP_LOGI(WIZ_TAG, "========================================");
+    
+    char response[512];
+    esp_err_t ret = wiz_get_pilot(bulb_ip, response, sizeof(response));
+    
+    if (ret == ESP_OK) {
+        ESP_LOGI(WIZ_TAG, "SUCCESS! Bulb responded:");
+        ESP_LOGI(WIZ_TAG, "%s", response);
+        ESP_LOGI(WIZ_TAG, "Bulb is reachable and responding!");
+        return ESP_OK;
+    } else {
+        ESP_LOGE(WIZ_TAG, "FAILED! Could not communicate with bulb");
+        ESP_LOGE(WIZ_TAG, "Check:");
+        ESP_LOGE(WIZ_TAG, "  1. Bulb IP address is correct: %s", bulb_ip);
+        ESP_LOGE(WIZ_TAG, "  2. Bulb is powered on");
+        ESP_LOGE(WIZ_TAG, "  3. ESP32 and bulb are on the same WiFi network");
+        return ESP_FAIL;
+    }
+}
+
+/**
+ * Discover WiZ bulbs on the network and update IPs based on MAC addresses
+ * Replies are picked up by the network task while the discovery window is open
+ */
+void wiz_discover_bulbs(void)
+{
+    ESP_LOGI(WIZ_TAG, "Starting WiZ bulb discovery...");
+
+    const char *msg = "{\"method\":\"getPilot\",\"params\":{}}";
+    if (wiz_net_submit(WIZ_PRIO_DISCOVERY, WIZ_BROADCAST_IP, msg, NULL, 0) != ESP_OK) {
+        ESP_LOGE(WIZ_TAG, "Failed to send discovery packet");
+        return;
+    }
+
+    // Listen for responses
+    vTaskDelay(pdMS_TO_TICKS(WIZ_DISCOVERY_WINDOW_MS));
+    ESP_LOGI(WIZ_TAG, "Discovery complete");
+}
+
+// ========== Multi-Controller Coordination ==========
+
+/**
+ * Rendezvous weight of a controller for a bulb - the highest weight owns it
+ * FNV-1a over the controller ID and the bulb MAC
+ */
+static uint32_t wiz_coord_weight(uint32_t id, const char *mac)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ ((id >> (i * 8)) & 0xff)) * 16777619u;
+    }
+    for (const char *c = mac; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+static bool wiz_peer_reaches(const wiz_peer_t *peer, const char *mac)
+{
+    for (int i = 0; i < peer->num_bulbs; i++) {
+        if (strcmp(peer->bulbs[i], mac) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Pick the owning controller for a bulb among live controllers that reach it
+ * Falls back to this controller if nobody has discovered the bulb. Caller holds coord_mutex.
+ */
+static uint32_t wiz_coord_owner(const char *mac)
+{
+    uint32_t owner = controller_id;
+    bool found = wiz_lookup_bulb_ip(mac) != NULL;
+    uint32_t best = found ? wiz_coord_weight(controller_id, mac) : 0;
+
+    for (int i = 0; i < num_peers; i++) {
+        if (!wiz_peer_reaches(&peers[i], mac)) {
+            continue;
+        }
+        uint32_t weight = wiz_coord_weight(peers[i].id, mac);
+        if (!found || weight > best || (weight == best && peers[i].id > owner)) {
+            owner = peers[i].id;
+            best = weight;
+            found = true;
+        }
+    }
+    return owner;
+}
+
+static wiz_desired_t *wiz_coord_find(const char *mac)
+{
+    for (int i = 0; i < num_desired; i++) {
+        if (strcmp(desired_table[i].mac, mac) == 0) {
+            return &desired_table[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * True if this controller or a live peer has discovered the bulb. Caller holds coord_mutex.
+ */
+static bool wiz_coord_reachable(const char *mac)
+{
+    if (wiz_lookup_bulb_ip(mac) != NULL) {
+        return true;
+    }
+    for (int i = 0; i < num_peers; i++) {
+        if (wiz_peer_reaches(&peers[i], mac)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Find a bulb's entry, adding one if some controller can reach the bulb
+ * MACs nobody has discovered (typos in a scene, bulbs that are gone) get no slot.
+ * A full table makes room by evicting an entry whose bulb nobody reaches any more.
+ * Caller holds coord_mutex.
+ */
+static wiz_desired_t *wiz_coord_find_or_add(const char *mac)
+{
+    wiz_desired_t *entry = wiz_coord_find(mac);
+    if (entry != NULL || !wiz_coord_reachable(mac)) {
+        return entry;
+    }
+
+    if (num_desired >= MAX_DESIRED) {
+        for (int i = 0; i < num_desired; i++) {
+            if (!wiz_coord_reachable(desired_table[i].mac)) {
+                ESP_LOGI(WIZ_TAG, "Evicting unreachable bulb %s from desired state", desired_table[i].mac);
+                desired_table[i] = desired_table[--num_desired];
+                break;
+            }
+        }
+        if (num_desired >= MAX_DESIRED) {
+            ESP_LOGW(WIZ_TAG, "Desired-state table full, not tracking %s", mac);
+            return NULL;
+        }
+    }
+
+    entry = &desired_table[num_desired++];
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->mac, mac, sizeof(entry->mac) - 1);
+    return entry;
+}
+
+/**
+ * Advance the Lamport clock past a version heard from anywhere. Caller holds coord_mutex.
+ */
+static void wiz_coord_observe(uint32_t version)
+{
+    if (version > coord_clock) {
+        coord_clock = version;
+    }
+}
+
+/**
+ * Send a datagram to the coordination group
+ */
+static void wiz_coord_send(const char *msg)
+{
+    if (coord_socket < 0 || !wifi_connected) {
+        return;
+    }
+
+    struct sockaddr_in dest_addr;
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(WIZ_COORD_PORT);
+    dest_addr.sin_addr.s_addr = inet_addr(WIZ_COORD_GROUP);
+
+    if (sendto(coord_socket, msg, strlen(msg), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+        ESP_LOGW(WIZ_TAG, "Coordination send failed: errno %d", errno);
+    }
+}
+
+static void wiz_coord_send_state(const wiz_desired_t *entry)
+{
+    char msg[192];
+    snprintf(msg, sizeof(msg),
+             "{\"type\":\"state\",\"id\":%lu,\"mac\":\"%s\",\"on\":%s,\"dimming\":%u,\"temp\":%u,"
+             "\"ver\":%lu,\"origin\":%lu}",
+             (unsigned long)controller_id, entry->mac, entry->on ? "true" : "false",
+             entry->dimming, entry->temp, (unsigned long)entry->version, (unsigned long)entry->origin);
+    wiz_coord_send(msg);
+}
+
+/**
+ * Announce this controller and the bulbs it can reach
+ */
+static void wiz_coord_send_hello(void)
+{
+    char msg[80 + MAX_KNOWN_BULBS * (WIZ_MAC_LEN + 3)];
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+    uint32_t clock = coord_clock;
+    xSemaphoreGive(coord_mutex);
+
+    int len = snprintf(msg, sizeof(msg), "{\"type\":\"hello\",\"id\":%lu,\"clock\":%lu,\"bulbs\":[",
+                       (unsigned long)controller_id, (unsigned long)clock);
+
+    for (int i = 0; i < num_known_bulbs; i++) {
+        len += snprintf(msg + len, sizeof(msg) - len, "%s\"%s\"", i ? "," : "", known_bulbs[i].mac);
+    }
+    snprintf(msg + len, sizeof(msg) - len, "]}");
+    wiz_coord_send(msg);
+}
+
+/**
+ * Create a version-0 entry from local switch state if nothing is known yet
+ * Peers' seeds compete on origin ID, so all controllers settle on one value.
+ */
+void wiz_coord_seed(const char *mac, bool on)
+{
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+    wiz_desired_t *entry = wiz_coord_find(mac);
+    if (entry == NULL) {
+        entry = wiz_coord_find_or_add(mac);
+        if (entry) {
+            entry->on = on;
+            entry->origin = controller_id;
+        }
+    }
+    xSemaphoreGive(coord_mutex);
+}
+
+/**
+ * Record a local change to a bulb's desired state and announce it to peers
+ * Returns true if this controller owns the bulb and should send the command itself.
+ */
+bool wiz_coord_publish(const char *mac, bool on, uint8_t dimming, uint16_t temp, wiz_desired_t *out)
+{
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+
+    wiz_desired_t *entry = wiz_coord_find_or_add(mac);
+    if (entry == NULL) {
+        // Nobody can reach the bulb (the caller finds no IP and skips it), or the
+        // table is full of reachable bulbs - behave like a single controller
+        xSemaphoreGive(coord_mutex);
+        memset(out, 0, sizeof(*out));
+        strncpy(out->mac, mac, sizeof(out->mac) - 1);
+        out->on = on;
+        out->dimming = dimming;
+        out->temp = temp;
+        return true;
+    }
+
+    entry->on = on;
+    entry->dimming = dimming;
+    entry->temp = temp;
+    // Lamport-correct: newer than anything this controller has heard of, for any bulb
+    wiz_coord_observe(entry->version);
+    entry->version = ++coord_clock;
+    entry->origin = controller_id;
+    entry->applied = false;
+    *out = *entry;
+    bool owner = wiz_coord_owner(mac) == controller_id;
+
+    xSemaphoreGive(coord_mutex);
+
+    wiz_coord_send_state(out);
+    return owner;
+}
+
+/**
+ * Mark an entry as sent. If a newer change replaced it while the send was in
+ * flight, the bulb may now show the older state even though the newer one was
+ * already marked applied - clear that so the next sync sends it again.
+ */
+void wiz_coord_mark_applied(const wiz_desired_t *sent)
+{
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+    wiz_desired_t *entry = wiz_coord_find(sent->mac);
+    if (entry) {
+        entry->applied = entry->version == sent->version && entry->origin == sent->origin;
+    }
+    xSemaphoreGive(coord_mutex);
+}
+
+/**
+ * Check that a copied entry is still the latest desired state for its bulb
+ */
+bool wiz_coord_is_current(const wiz_desired_t *copy)
+{
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+    wiz_desired_t *entry = wiz_coord_find(copy->mac);
+    bool current = entry == NULL ||
+                   (entry->version == copy->version && entry->origin == copy->origin);
+    xSemaphoreGive(coord_mutex);
+    return current;
+}
+
+/**
+ * Copy out table entry index if this controller owns it and has not sent it yet
+ */
+bool wiz_coord_unapplied(int index, wiz_desired_t *out)
+{
+    bool pending = false;
+
+    if (!wiz_coord_settled()) {
+        return false;
+    }
+
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+    if (index < num_desired && !desired_table[index].applied &&
+        wiz_coord_owner(desired_table[index].mac) == controller_id) {
+        *out = desired_table[index];
+        pending = true;
+    }
+    xSemaphoreGive(coord_mutex);
+
+    return pending;
+}
+
+/**
+ * Merge a peer's state update; the owner hands newly accepted states to the
+ * control task, which sends them as a burst so heartbeats never wait on bulbs
+ */
+static void wiz_coord_handle_state(const cJSON *root)
+{
+    cJSON *mac = cJSON_GetObjectItem(root, "mac");
+    cJSON *on = cJSON_GetObjectItem(root, "on");
+    cJSON *ver = cJSON_GetObjectItem(root, "ver");
+    cJSON *origin = cJSON_GetObjectItem(root, "origin");
+    cJSON *dimming = cJSON_GetObjectItem(root, "dimming");
+    cJSON *temp = cJSON_GetObjectItem(root, "temp");
+    if (!mac || !cJSON_IsString(mac) || !on || !cJSON_IsBool(on) ||
+        !ver || !cJSON_IsNumber(ver) || !origin || !cJSON_IsNumber(origin)) {
+        return;
+    }
+
+    uint32_t version = (uint32_t)ver->valuedouble;
+    uint32_t origin_id = (uint32_t)origin->valuedouble;
+    bool send = false;
+    wiz_desired_t accepted;
+
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+    wiz_coord_observe(version);
+    wiz_desired_t *entry = wiz_coord_find_or_add(mac->valuestring);
+    if (entry && (version > entry->version || (version == entry->version && origin_id > entry->origin))) {
+        entry->on = cJSON_IsTrue(on);
+        entry->dimming = (dimming && cJSON_IsNumber(dimming)) ? (uint8_t)dimming->valueint : 0;
+        entry->temp = (temp && cJSON_IsNumber(temp)) ? (uint16_t)temp->valueint : 0;
+        entry->version = version;
+        entry->origin = origin_id;
+        entry->applied = false;
+        accepted = *entry;
+        send = wiz_coord_owner(entry->mac) == controller_id;
+    }
+    xSemaphoreGive(coord_mutex);
+
+    if (!send) {
+        return;
+    }
+
+    ESP_LOGI(WIZ_TAG, "Peer %08lx set bulb %s %s (v%lu)", (unsigned long)origin_id,
+             accepted.mac, accepted.on ? "ON" : "OFF", (unsigned long)version);
+    wiz_control_handoff(&accepted);
+}
+
+/**
+ * Record a peer heartbeat and the bulbs it can reach
+ */
+static void wiz_coord_handle_hello(const cJSON *root, uint32_t id, int64_t now_us)
+{
+    cJSON *bulbs = cJSON_GetObjectItem(root, "bulbs");
+    cJSON *clock = cJSON_GetObjectItem(root, "clock");
+
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+
+    if (clock && cJSON_IsNumber(clock)) {
+        wiz_coord_observe((uint32_t)clock->valuedouble);
+    }
+
+    wiz_peer_t *peer = NULL;
+    for (int i = 0; i < num_peers; i++) {
+        if (peers[i].id == id) {
+            peer = &peers[i];
+            break;
+        }
+    }
+
+    if (peer == NULL) {
+        if (num_peers >= MAX_PEERS) {
+            xSemaphoreGive(coord_mutex);
+            ESP_LOGW(WIZ_TAG, "Peer table full, ignoring controller %08lx", (unsigned long)id);
+            return;
+        }
+        peer = &peers[num_peers++];
+        memset(peer, 0, sizeof(*peer));
+        peer->id = id;
+        ESP_LOGI(WIZ_TAG, "Controller %08lx joined", (unsigned long)id);
+    }
+
+    peer->last_seen_us = now_us;
+    peer->num_bulbs = 0;
+    if (bulbs && cJSON_IsArray(bulbs)) {
+        cJSON *item;
+        cJSON_ArrayForEach(item, bulbs) {
+            if (cJSON_IsString(item) && peer->num_bulbs < MAX_KNOWN_BULBS) {
+                strncpy(peer->bulbs[peer->num_bulbs], item->valuestring, WIZ_MAC_LEN - 1);
+                peer->bulbs[peer->num_bulbs][WIZ_MAC_LEN - 1] = '\0';
+                peer->num_bulbs++;
+            }
+        }
+    }
+
+    xSemaphoreGive(coord_mutex);
+}
+
+/**
+ * Drop silent peers; bulbs that fail over to us are resent by the next sync
+ */
+static void wiz_coord_expire_peers(int64_t now_us)
+{
+    xSemaphoreTake(coord_mutex, portMAX_DELAY);
+
+    for (int i = 0; i < num_peers; ) {
+        if (now_us - peers[i].last_seen_us < (int64_t)WIZ_COORD_PEER_TIMEOUT_MS * 1000) {
+            i++;
+            continue;
+        }
+
+        uint32_t lost_id = peers[i].id;
+        bool owned_before[MAX_DESIRED];
+        for (int j = 0; j < num_desired; j++) {
+            owned_before[j] = wiz_coord_owner(desired_table[j].mac) == controller_id;
+        }
+
+        peers[i] = peers[--num_peers];
+
+        int taken = 0;
+        for (int j = 0; j < num_desired; j++) {
+            if (!owned_before[j] && wiz_coord_owner(desired_table[j].mac) == controller_id) {
+                desired_table[j].applied = false;
+                taken++;
+            }
+        }
+        ESP_LOGW(WIZ_TAG, "Controller %08lx lost, took over %d bulbs", (unsigned long)lost_id, taken);
+    }
+
+    xSemaphoreGive(coord_mutex);
+}
+
+/**
+ * Re-announce a few desired-state entries so late joiners and lost packets converge
+ */
+static void wiz_coord_resync(int *cursor)
+{
+    for (int n = 0; n < WIZ_COORD_RESYNC_PER_HELLO; n++) {
+        wiz_desired_t entry;
+        bool have = false;
+
+        xSemaphoreTake(coord_mutex, portMAX_DELAY);
+        if (num_desired > 0) {
+            *cursor %= num_desired;
+            entry = desired_table[(*cursor)++];
+            have = true;
+        }
+        xSemaphoreGive(coord_mutex);
+
+        if (!have) {
+            return;
+        }
+        wiz_coord_send_state(&entry);
+    }
+}
+
+/**
+ * Send the whole desired-state table - the answer to a rebooted peer's join
+ */
+static void wiz_coord_dump(void)
+{
+    for (int i = 0; i < MAX_DESIRED; i++) {
+        wiz_desired_t entry;
+        bool have = false;
+
+        xSemaphoreTake(coord_mutex, portMAX_DELAY);
+        if (i < num_desired) {
+            entry = desired_table[i];
+            have = true;
+        }
+        xSemaphoreGive(coord_mutex);
+
+        if (!have) {
+            return;
+        }
+        wiz_coord_send_state(&entry);
+    }
+}
+
+/**
+ * True once a joining controller has heard its peers for a full peer timeout
+ * Until then its table may hold seeds that lose to state it has not received yet.
+ */
+bool wiz_coord_settled(void)
+{
+    return esp_timer_get_time() >= coord_settle_us;
+}
+
+/**
+ * Coordination task - heartbeats, peer expiry and incoming state updates
+ */
+static void wiz_coord_task(void *pvParameters)
+{
+    static char rx_buffer[WIZ_COORD_RX_MAX];
+    int64_t last_hello_us = 0;
+    int resync_cursor = 0;
+
+    ESP_LOGI(WIZ_TAG, "Coordination task started, controller ID %08lx", (unsigned long)controller_id);
+
+    // Ask running peers for their full table instead of waiting for resync to cycle through it
+    char join[64];
+    snprintf(join, sizeof(join), "{\"type\":\"join\",\"id\":%lu}", (unsigned long)controller_id);
+    wiz_coord_send(join);
+
+    while (1) {
+        if (coord_dump_requested) {
+            coord_dump_requested = false;
+            wiz_coord_send_hello();
+            wiz_coord_dump();
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_hello_us >= (int64_t)WIZ_COORD_HELLO_MS * 1000) {
+            wiz_coord_send_hello();
+            wiz_coord_resync(&resync_cursor);
+            wiz_coord_expire_peers(now_us);
+            last_hello_us = now_us;
+        }
+
+        // Socket has a short receive timeout so heartbeats stay on schedule
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(coord_socket, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&from, &from_len);
+        if (len <= 0) {
+            continue;
+        }
+        rx_buffer[len] = '\0';
+
+        cJSON *root = cJSON_Parse(rx_buffer);
+        if (root == NULL) {
+            continue;
+        }
+
+        cJSON *type = cJSON_GetObjectItem(root, "type");
+        cJSON *id = cJSON_GetObjectItem(root, "id");
+        cJSON *target = cJSON_GetObjectItem(root, "target");
+        if (type && cJSON_IsString(type) && strcmp(type->valuestring, "control") == 0) {
+            // Commands from tools, addressed to one controller; applies can take a while,
+            // so they run on the control task and heartbeats stay on schedule
+            if (target && cJSON_IsNumber(target) && (uint32_t)target->valuedouble == controller_id) {
+                wiz_control_submit(root, &from);
+                continue;
+            }
+        } else if (type && cJSON_IsString(type) && id && cJSON_IsNumber(id)) {
+            uint32_t sender = (uint32_t)id->valuedouble;
+            // Multicast loopback delivers our own messages too
+            if (sender != controller_id) {
+                if (strcmp(type->valuestring, "hello") == 0) {
+                    wiz_coord_handle_hello(root, sender, esp_timer_get_time());
+                } else if (strcmp(type->valuestring, "state") == 0) {
+                    wiz_coord_handle_state(root);
+                } else if (strcmp(type->valuestring, "join") == 0) {
+                    ESP_LOGI(WIZ_TAG, "Controller %08lx (re)joined, sending state", (unsigned long)sender);
+                    coord_dump_requested = true;
+                }
+            }
+        }
+        cJSON_Delete(root);
+    }
+}
+
+/**
+ * Join the coordination multicast group and start the coordination task
+ * Without it this controller simply owns every bulb it can reach.
+ */
+esp_err_t wiz_coord_init(void)
+{
+    if (coord_mutex == NULL) {
+        coord_mutex = xSemaphoreCreateMutexStatic(&coord_mutex_buf);
+    }
+
+    // Controller ID from the low bytes of the station MAC
+    uint8_t mac[6];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    controller_id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+
+    coord_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (coord_socket < 0) {
+        ESP_LOGE(WIZ_TAG, "Failed to create coordination socket");
+        return ESP_FAIL;
+    }
+
+    // Several controllers may share one host when testing
+    int reuse = 1;
+    setsockopt(coord_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in bind_addr;
+    memset(&bind_addr, 0, sizeof(bind_addr));
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_port = htons(WIZ_COORD_PORT);
+    bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(coord_socket, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        ESP_LOGE(WIZ_TAG, "Failed to bind coordination socket: errno %d", errno);
+        close(coord_socket);
+        coord_socket = -1;
+        return ESP_FAIL;
+    }
+
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr.s_addr = inet_addr(WIZ_COORD_GROUP);
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(coord_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        ESP_LOGE(WIZ_TAG, "Failed to join %s: errno %d", WIZ_COORD_GROUP, errno);
+        close(coord_socket);
+        coord_socket = -1;
+        return ESP_FAIL;
+    }
+
+    uint8_t ttl = 1;
+    setsockopt(coord_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    setsockopt(coord_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    coord_settle_us = esp_timer_get_time() + (int64_t)WIZ_COORD_PEER_TIMEOUT_MS * 1000;
+
+    if (xTaskCreate(wiz_coord_task, "wiz_coord", 6144, NULL, 8, NULL) != pdPASS) {
+        coord_settle_us = 0;
+        ESP_LOGE(WIZ_TAG, "Failed to create coordination task");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(WIZ_TAG, "Joined coordination group %s:%d", WIZ_COORD_GROUP, WIZ_COORD_PORT);
+    return ESP_OK;
+}
+
+// ========== Scenes and Groups ==========
+
+/**
+ * Write a table to NVS as a single blob
+ */
+static esp_err_t wiz_nvs_save(const char *key, const void *data, size_t size)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(WIZ_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(WIZ_TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = nvs_set_blob(nvs, key, data, size);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(WIZ_TAG, "Failed to save %s: %s", key, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * Read a table blob from NVS; fails if missing or of a different size
+ */
+static esp_err_t wiz_nvs_load(const char *key, void *data, size_t size)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(WIZ_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    size_t stored_size = size;
+    ret = nvs_get_blob(nvs, key, data, &stored_size);
+    nvs_close(nvs);
+
+    if (ret == ESP_OK && stored_size != size) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ret;
+}
+
+/**
+ * Check the stored schema version, recording the current one if it is missing.
+ * Returns false if the namespace was written by a different layout.
+ */
+static bool wiz_nvs_schema_ok(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIZ_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return false;
+    }
+
+    uint8_t schema = 0;
+    bool ok = true;
+    esp_err_t ret = nvs_get_u8(nvs, "schema", &schema);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        // Fresh namespace, or tables saved before the key existed - validation decides
+        nvs_set_u8(nvs, "schema", WIZ_NVS_SCHEMA);
+        nvs_commit(nvs);
+    } else if (ret != ESP_OK || schema != WIZ_NVS_SCHEMA) {
+        ESP_LOGW(WIZ_TAG, "NVS schema %d, expected %d - resetting scenes and groups", schema, WIZ_NVS_SCHEMA);
+        nvs_erase_all(nvs);
+        nvs_set_u8(nvs, "schema", WIZ_NVS_SCHEMA);
+        nvs_commit(nvs);
+        ok = false;
+    }
+    nvs_close(nvs);
+    return ok;
+}
+
+static bool wiz_str_valid(const char *s, size_t size)
+{
+    return memchr(s, '\0', size) != NULL;
+}
+
+static bool wiz_mac_valid(const char *mac, size_t size)
+{
+    if (!wiz_str_valid(mac, size) || strlen(mac) != WIZ_MAC_LEN - 1) {
+        return false;
+    }
+    for (const char *c = mac; *c; c++) {
+        if (!isxdigit((unsigned char)*c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool wiz_scene_valid(const wiz_scene_t *scene)
+{
+    if (!wiz_str_valid(scene->name, sizeof(scene->name)) || scene->name[0] == '\0' ||
+        scene->num_entries > MAX_SCENE_BULBS) {
+        return false;
+    }
+    for (int i = 0; i < scene->num_entries; i++) {
+        const wiz_scene_entry_t *e = &scene->entries[i];
+        if (!wiz_mac_valid(e->mac, sizeof(e->mac)) ||
+            (e->dimming != 0 && (e->dimming < 10 || e->dimming > 100)) ||
+            (e->temp != 0 && (e->temp < 2200 || e->temp > 6500))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool wiz_group_valid(const wiz_group_t *group)
+{
+    if (!wiz_str_valid(group->name, sizeof(group->name)) || group->name[0] == '\0' ||
+        group->num_bulbs > MAX_SCENE_BULBS) {
+        return false;
+    }
+    for (int i = 0; i < group->num_bulbs; i++) {
+        if (!wiz_mac_valid(group->macs[i], sizeof(group->macs[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * A blob of the right size can still hold garbage (layout change at the same
+ * size, partial write) - every count is used as a loop bound, so check them all
+ */
+static bool wiz_scene_table_valid(const wiz_scene_table_t *table)
+{
+    if (table->num_scenes > MAX_SCENES) {
+        return false;
+    }
+    for (int i = 0; i < table->num_scenes; i++) {
+        if (!wiz_scene_valid(&table->scenes[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool wiz_group_table_valid(const wiz_group_table_t *table)
+{
+    if (table->num_groups > MAX_GROUPS) {
+        return false;
+    }
+    for (int i = 0; i < table->num_groups; i++) {
+        if (!wiz_group_valid(&table->groups[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Load scenes and groups from NVS, seeding them from the defaults on first boot
+ * or when the stored tables are from another schema or fail validation
+ */
+void wiz_scenes_init(void)
+{
+    burst_mutex = xSemaphoreCreateMutexStatic(&burst_mutex_buf);
+
+    bool schema_ok = wiz_nvs_schema_ok();
+
+    if (!schema_ok || wiz_nvs_load("scenes", &scene_table, sizeof(scene_table)) != ESP_OK ||
+        !wiz_scene_table_valid(&scene_table)) {
+        memset(&scene_table, 0, sizeof(scene_table));
+        for (int i = 0; i < (int)(sizeof(default_scenes) / sizeof(default_scenes[0])) && i < MAX_SCENES; i++) {
+            scene_table.scenes[scene_table.num_scenes++] = default_scenes[i];
+        }
+        wiz_nvs_save("scenes", &scene_table, sizeof(scene_table));
+    }
+
+    if (!schema_ok || wiz_nvs_load("groups", &group_table, sizeof(group_table)) != ESP_OK ||
+        !wiz_group_table_valid(&group_table)) {
+        memset(&group_table, 0, sizeof(group_table));
+        for (int i = 0; i < (int)(sizeof(default_groups) / sizeof(default_groups[0])) && i < MAX_GROUPS; i++) {
+            group_table.groups[group_table.num_groups++] = default_groups[i];
+        }
+        wiz_nvs_save("groups", &group_table, sizeof(group_table));
+    }
+
+    ESP_LOGI(WIZ_TAG, "Loaded %d scenes and %d groups", scene_table.num_scenes, group_table.num_groups);
+}
+
+static wiz_scene_t *wiz_scene_find(const char *name)
+{
+    for (int i = 0; i < scene_table.num_scenes; i++) {
+        if (strcmp(scene_table.scenes[i].name, name) == 0) {
+            return &scene_table.scenes[i];
+        }
+    }
+    return NULL;
+}
+
+static wiz_group_t *wiz_group_find(const char *name)
+{
+    for (int i = 0; i < group_table.num_groups; i++) {
+        if (strcmp(group_table.groups[i].name, name) == 0) {
+            return &group_table.groups[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add or replace a scene by name and persist the scene table
+ */
+esp_err_t wiz_scene_store(const wiz_scene_t *scene)
+{
+    if (!wiz_scene_valid(scene)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(burst_mutex, portMAX_DELAY);
+    wiz_scene_t *slot = wiz_scene_find(scene->name);
+    if (slot == NULL) {
+        if (scene_table.num_scenes >= MAX_SCENES) {
+            xSemaphoreGive(burst_mutex);
+            ESP_LOGE(WIZ_TAG, "Scene table full, cannot store '%s'", scene->name);
+            return ESP_ERR_NO_MEM;
+        }
+        slot = &scene_table.scenes[scene_table.num_scenes++];
+    }
+
+    *slot = *scene;
+    esp_err_t ret = wiz_nvs_save("scenes", &scene_table, sizeof(scene_table));
+    xSemaphoreGive(burst_mutex);
+    return ret;
+}
+
+/**
+ * Add or replace a group by name and persist the group table
+ */
+esp_err_t wiz_group_store(const wiz_group_t *group)
+{
+    if (!wiz_group_valid(group)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(burst_mutex, portMAX_DELAY);
+    wiz_group_t *slot = wiz_group_find(group->name);
+    if (slot == NULL) {
+        if (group_table.num_groups >= MAX_GROUPS) {
+            xSemaphoreGive(burst_mutex);
+            ESP_LOGE(WIZ_TAG, "Group table full, cannot store '%s'", group->name);
+            return ESP_ERR_NO_MEM;
+        }
+        slot = &group_table.groups[group_table.num_groups++];
+    }
+
+    *slot = *group;
+    esp_err_t ret = wiz_nvs_save("groups", &group_table, sizeof(group_table));
+    xSemaphoreGive(burst_mutex);
+    return ret;
+}
+
+/**
+ * Publish a bulb's new state and add it to the burst if this controller owns it
+ * Bulbs owned by a peer are sent by that peer; undiscovered bulbs are skipped.
+ */
+static void wiz_burst_add(const char *mac, bool on, uint8_t dimming, uint16_t temp)
+{
+    wiz_desired_t entry;
+    if (!wiz_coord_publish(mac, on, dimming, temp, &entry)) {
+        burst.handed++;
+        return;
+    }
+
+    const char *ip = wiz_lookup_bulb_ip(mac);
+    if (ip == NULL) {
+        ESP_LOGW(WIZ_TAG, "Bulb %s not discovered, skipping", mac);
+        burst.skipped++;
+        return;
+    }
+
+    int i = burst.count++;
+    burst.desired[i] = entry;
+    strncpy(burst.ips[i], ip, sizeof(burst.ips[i]) - 1);
+    burst.ips[i][sizeof(burst.ips[i]) - 1] = '\0';
+    wiz_build_pilot(burst.payloads[i], sizeof(burst.payloads[i]), on, dimming, temp);
+    burst.acked[i] = false;
+}
+
+static void wiz_burst_reset(void)
+{
+    burst.count = 0;
+    burst.handed = 0;
+    burst.skipped = 0;
+}
 
 /**
- * Initialize UDP socket for WiZ bulb communication
+ * Queue every payload of the burst in one go and collect the acks in parallel
+ * Bulbs that do not ack are resent up to WIZ_SCENE_MAX_ATTEMPTS times.
+ * Returns the number of bulbs that acked.
  */
-esp_err_t wiz_udp_init(void)
+static int wiz_burst_send(wiz_prio_t prio)
 {
-    if (udp_socket >= 0) {
-        close(udp_socket);
-    }
+    StaticSemaphore_t done_buf;
+    SemaphoreHandle_t done = xSemaphoreCreateCountingStatic(MAX_SCENE_BULBS, 0, &done_buf);
+    int acked = 0;
 
-    udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (udp_socket < 0) {
-        ESP_LOGE(WIZ_TAG, "Failed to create UDP socket");
-        return ESP_FAIL;
+    for (int attempt = 0; attempt < WIZ_SCENE_MAX_ATTEMPTS && acked < burst.count; attempt++) {
+        int queued = 0;
+        for (int i = 0; i < burst.count; i++) {
+            if (burst.acked[i]) {
+                continue;
+            }
+            burst.results[i] = ESP_FAIL;
+            burst.acks[i][0] = '\0';
+            if (wiz_net_enqueue(prio, burst.ips[i], burst.payloads[i], burst.acks[i], sizeof(burst.acks[i]),
+                                WIZ_SCENE_ACK_TIMEOUT_MS, done, &burst.results[i], false) == ESP_OK) {
+                queued++;
+            }
+        }
+        wiz_net_kick();
+
+        for (int i = 0; i < queued; i++) {
+            xSemaphoreTake(done, portMAX_DELAY);
+        }
+
+        for (int i = 0; i < burst.count; i++) {
+            if (!burst.acked[i] && burst.results[i] == ESP_OK &&
+                strstr(burst.acks[i], "\"success\":true") != NULL) {
+                burst.acked[i] = true;
+                acked++;
+            }
+        }
+
+        if (acked < burst.count && attempt + 1 < WIZ_SCENE_MAX_ATTEMPTS) {
+            ESP_LOGW(WIZ_TAG, "%d/%d bulbs acked, resending to the rest", acked, burst.count);
+        }
     }
 
-    // Set socket timeout
-    struct timeval timeout;
-    timeout.tv_sec = 2;
-    timeout.tv_usec = 0;
-    setsockopt(udp_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    vSemaphoreDelete(done);
+    return acked;
+}
 
-    ESP_LOGI(WIZ_TAG, "UDP socket initialized");
-    return ESP_OK;
+static void wiz_burst_note_acked(void)
+{
+    for (int i = 0; i < burst.count; i++) {
+        if (burst.acked[i]) {
+            wiz_coord_mark_applied(&burst.desired[i]);
+        }
+    }
 }
 
 /**
- * Send JSON command to WiZ bulb via UDP
+ * Keep the outcome of the burst for the "stats" control command and copy it to
+ * the caller's result, if any. Caller holds burst_mutex.
  */
-esp_err_t wiz_send_command(const char *bulb_ip, const char *json_command)
+static void wiz_burst_record(const char *name, int acked, int64_t elapsed_ms, wiz_apply_result_t *result)
 {
-    if (udp_socket < 0) {
-        ESP_LOGE(WIZ_TAG, "UDP socket not initialized");
-        return ESP_FAIL;
+    strncpy(last_apply.name, name, sizeof(last_apply.name) - 1);
+    last_apply.name[sizeof(last_apply.name) - 1] = '\0';
+    last_apply.acked = acked;
+    last_apply.total = burst.count + burst.skipped;
+    last_apply.handed = burst.handed;
+    last_apply.elapsed_ms = elapsed_ms;
+    if (result) {
+        *result = last_apply;
     }
+}
 
-    if (!wifi_connected) {
-        ESP_LOGE(WIZ_TAG, "WiFi not connected");
-        return ESP_FAIL;
+/**
+ * Apply a scene in a single burst - activate=false turns all of its bulbs off
+ * result (optional) receives this apply's counts; it is untouched if the scene is unknown.
+ */
+esp_err_t wiz_scene_apply(const char *name, bool activate, wiz_prio_t prio, wiz_apply_result_t *result)
+{
+    // The table can be edited by the control task - hold the burst lock while using it
+    xSemaphoreTake(burst_mutex, portMAX_DELAY);
+    wiz_scene_t *scene = wiz_scene_find(name);
+    if (scene == NULL) {
+        xSemaphoreGive(burst_mutex);
+        ESP_LOGE(WIZ_TAG, "Unknown scene '%s'", name);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    struct sockaddr_in dest_addr;
-    dest_addr.sin_addr.s_addr = inet_addr(bulb_ip);
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(WIZ_PORT);
-
-    int len = strlen(json_command);
-    int err = sendto(udp_socket, json_command, len, 0,
-                     (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    int64_t start_us = esp_timer_get_time();
 
-    if (err < 0) {
-        ESP_LOGE(WIZ_TAG, "Error occurred during sending: errno %d", errno);
-        return ESP_FAIL;
+    // Build every payload up front so the burst goes out back to back
+    wiz_burst_reset();
+    for (int i = 0; i < scene->num_entries; i++) {
+        const wiz_scene_entry_t *entry = &scene->entries[i];
+        wiz_burst_add(entry->mac, activate && entry->on, entry->dimming, entry->temp);
     }
 
-    ESP_LOGI(WIZ_TAG, "Sent to %s: %s", bulb_ip, json_command);
-    return ESP_OK;
+    int acked = wiz_burst_send(prio);
+    int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+
+    wiz_burst_note_acked();
+    wiz_burst_record(name, acked, elapsed_ms, result);
+
+    ESP_LOGI(WIZ_TAG, "Scene '%s' %s: %d/%d bulbs acked in %lld ms (%d sent by peers)",
+             name, activate ? "applied" : "turned off", acked, burst.count + burst.skipped,
+             (long long)elapsed_ms, burst.handed);
+
+    bool all_acked = (acked == burst.count && burst.skipped == 0);
+    xSemaphoreGive(burst_mutex);
+    return all_acked ? ESP_OK : ESP_FAIL;
 }
 
 /**
- * Receive response from WiZ bulb
+ * Turn every bulb in a group on or off in a single burst
+ * result (optional) receives this apply's counts; it is untouched if the group is unknown.
  */
-esp_err_t wiz_receive_response(char *buffer, size_t buffer_size)
+esp_err_t wiz_group_set_state(const char *name, bool on, wiz_prio_t prio, wiz_apply_result_t *result)
 {
-    if (udp_socket < 0) {
-        return ESP_FAIL;
+    xSemaphoreTake(burst_mutex, portMAX_DELAY);
+    wiz_group_t *group = wiz_group_find(name);
+    if (group == NULL) {
+        xSemaphoreGive(burst_mutex);
+        ESP_LOGE(WIZ_TAG, "Unknown group '%s'", name);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    struct sockaddr_in source_addr;
-    socklen_t socklen = sizeof(source_addr);
-    int len = recvfrom(udp_socket, buffer, buffer_size - 1, 0,
-                       (struct sockaddr *)&source_addr, &socklen);
+    int64_t start_us = esp_timer_get_time();
 
-    if (len < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            ESP_LOGW(WIZ_TAG, "No response received (timeout)");
-        } else {
-            ESP_LOGE(WIZ_TAG, "recvfrom failed: errno %d", errno);
-        }
-        return ESP_FAIL;
+    wiz_burst_reset();
+    for (int i = 0; i < group->num_bulbs; i++) {
+        wiz_burst_add(group->macs[i], on, 0, 0);
     }
 
-    buffer[len] = '\0';
-    ESP_LOGI(WIZ_TAG, "Received from %s: %s", inet_ntoa(source_addr.sin_addr), buffer);
-    return ESP_OK;
+    int acked = wiz_burst_send(prio);
+    int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+
+    wiz_burst_note_acked();
+    wiz_burst_record(name, acked, elapsed_ms, result);
+
+    ESP_LOGI(WIZ_TAG, "Group '%s' %s: %d/%d bulbs acked in %lld ms (%d sent by peers)",
+             name, on ? "ON" : "OFF", acked, burst.count + burst.skipped,
+             (long long)elapsed_ms, burst.handed);
+
+    bool all_acked = (acked == burst.count && burst.skipped == 0);
+    xSemaphoreGive(burst_mutex);
+    return all_acked ? ESP_OK : ESP_FAIL;
 }
 
 /**
- * Get current WiZ bulb state (discovery/test function)
+ * Send states handed over by peers in a single burst; acked ones are marked applied
+ * States replaced since they were queued are left to their newer handoff or to sync.
  */
-esp_err_t wiz_get_pilot(const char *bulb_ip, char *response_buffer, size_t buffer_size)
+static void wiz_handoff_send(const wiz_desired_t *states, int count)
 {
-    const char *json_cmd = "{\"method\":\"getPilot\",\"params\":{}}";
-    
-    esp_err_t ret = wiz_send_command(bulb_ip, json_cmd);
-    if (ret != ESP_OK) {
-        return ret;
+    xSemaphoreTake(burst_mutex, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+
+    wiz_burst_reset();
+    for (int i = 0; i < count; i++) {
+        const char *ip = wiz_lookup_bulb_ip(states[i].mac);
+        if (ip == NULL || !wiz_coord_is_current(&states[i])) {
+            continue;
+        }
+        int n = burst.count++;
+        burst.desired[n] = states[i];
+        strncpy(burst.ips[n], ip, sizeof(burst.ips[n]) - 1);
+        burst.ips[n][sizeof(burst.ips[n]) - 1] = '\0';
+        wiz_build_pilot(burst.payloads[n], sizeof(burst.payloads[n]),
+                        states[i].on, states[i].dimming, states[i].temp);
+        burst.acked[n] = false;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(200)); // Wait for response
-    return wiz_receive_response(response_buffer, buffer_size);
+    if (burst.count > 0) {
+        int acked = wiz_burst_send(WIZ_PRIO_BURST);
+        wiz_burst_note_acked();
+        ESP_LOGI(WIZ_TAG, "Handed-over states: %d/%d bulbs acked in %lld ms", acked, burst.count,
+                 (long long)((esp_timer_get_time() - start_us) / 1000));
+    }
+    xSemaphoreGive(burst_mutex);
 }
 
+// ========== Remote Control ==========
+
 /**
- * Turn WiZ bulb on or off with retry logic
+ * Queue a control command for the control task, which takes ownership of root
  */
-esp_err_t wiz_set_state(const char *bulb_ip, bool on)
+void wiz_control_submit(cJSON *root, const struct sockaddr_in *from)
 {
-    char json_cmd[128];
-    snprintf(json_cmd, sizeof(json_cmd),
-             "{\"method\":\"setPilot\",\"params\":{\"state\":%s}}",
-             on ? "true" : "false");
-    
-    const int MAX_RETRIES = 3;
-    const int RETRY_DELAY_MS = 200;
-    
-    for (int attempt = 0; attempt < MAX_RETRIES; attempt++) {
-        esp_err_t ret = wiz_send_command(bulb_ip, json_cmd);
-        if (ret == ESP_OK) {
-            if (attempt > 0) {
-                ESP_LOGW(WIZ_TAG, "Bulb command succeeded on attempt %d", attempt + 1);
-            }
-            return ESP_OK;
-        }
-        
-        if (attempt < MAX_RETRIES - 1) {
-            ESP_LOGW(WIZ_TAG, "Bulb command failed, retrying in %dms (attempt %d/%d)", 
-                     RETRY_DELAY_MS, attempt + 1, MAX_RETRIES);
-            vTaskDelay(pdMS_TO_TICKS(RETRY_DELAY_MS));
-        }
+    wiz_control_msg_t msg = { .root = root, .from = *from };
+    if (control_queue == NULL || xQueueSend(control_queue, &msg, 0) != pdTRUE) {
+        ESP_LOGW(WIZ_TAG, "Control queue full, dropping command");
+        cJSON_Delete(root);
     }
-    
-    ESP_LOGE(WIZ_TAG, "Failed to set bulb state after %d attempts", MAX_RETRIES);
-    return ESP_FAIL;
 }
 
 /**
- * Discover and test communication with WiZ bulb
+ * Queue a peer's state for sending by this controller without blocking the caller
+ * If the queue is full the entry stays unapplied and the next sync sends it.
  */
-esp_err_t wiz_discover_and_test(const char *bulb_ip)
+void wiz_control_handoff(const wiz_desired_t *entry)
 {
-    ESP_LOGI(WIZ_TAG, "========================================");
-    ESP_LOGI(WIZ_TAG, "Testing communication with bulb: %s", bulb_ip);
-    ESP_LOGI(WIZ_TAG, "========================================");
-    
-    char response[512];
-    esp_err_t ret = wiz_get_pilot(bulb_ip, response, sizeof(response));
-    
-    if (ret == ESP_OK) {
-        ESP_LOGI(WIZ_TAG, "SUCCESS! Bulb responded:");
-        ESP_LOGI(WIZ_TAG, "%s", response);
-        ESP_LOGI(WIZ_TAG, "Bulb is reachable and responding!");
-        return ESP_OK;
-    } else {
-        ESP_LOGE(WIZ_TAG, "FAILED! Could not communicate with bulb");
-        ESP_LOGE(WIZ_TAG, "Check:");
-        ESP_LOGE(WIZ_TAG, "  1. Bulb IP address is correct: %s", bulb_ip);
-        ESP_LOGE(WIZ_TAG, "  2. Bulb is powered on");
-        ESP_LOGE(WIZ_TAG, "  3. ESP32 and bulb are on the same WiFi network");
-        return ESP_FAIL;
+    wiz_control_msg_t msg = { .root = NULL, .handoff = *entry };
+    if (control_queue == NULL || xQueueSend(control_queue, &msg, 0) != pdTRUE) {
+        ESP_LOGW(WIZ_TAG, "Control queue full, leaving bulb %s to sync", entry->mac);
+    }
+}
+
+static void wiz_control_reply(const struct sockaddr_in *to, const char *cmd, esp_err_t ret, const char *extra)
+{
+    char msg[384];
+    snprintf(msg, sizeof(msg), "{\"type\":\"control_reply\",\"id\":%lu,\"cmd\":\"%s\",\"ok\":%s,\"err\":\"%s\"%s}",
+             (unsigned long)controller_id, cmd, ret == ESP_OK ? "true" : "false", esp_err_to_name(ret),
+             extra ? extra : "");
+    sendto(coord_socket, msg, strlen(msg), 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+static bool wiz_json_name(const cJSON *root, char *name)
+{
+    cJSON *item = cJSON_GetObjectItem(root, "name");
+    if (!item || !cJSON_IsString(item) || strlen(item->valuestring) >= WIZ_NAME_MAX) {
+        return false;
     }
+    strcpy(name, item->valuestring);
+    return true;
 }
 
 /**
- * Discover WiZ bulbs on the network and update IPs based on MAC addresses
+ * Read an optional numeric field; absent means 0. Out-of-range values fail
+ * here instead of wrapping when narrowed to the stored type.
  */
-void wiz_discover_bulbs(void)
+static bool wiz_json_uint(const cJSON *root, const char *key, uint32_t max, uint32_t *out)
 {
-    ESP_LOGI(WIZ_TAG, "Starting WiZ bulb discovery...");
-    
-    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock < 0) {
-        ESP_LOGE(WIZ_TAG, "Failed to create discovery socket");
-        return;
+    cJSON *item = cJSON_GetObjectItem(root, key);
+    *out = 0;
+    if (item == NULL) {
+        return true;
+    }
+    if (!cJSON_IsNumber(item) || item->valuedouble < 0 || item->valuedouble > max ||
+        item->valuedouble != (double)item->valueint) {
+        return false;
     }
+    *out = (uint32_t)item->valueint;
+    return true;
+}
 
-    // Enable broadcast
-    int broadcast = 1;
-    if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
-        ESP_LOGE(WIZ_TAG, "Failed to enable broadcast");
-        close(sock);
-        return;
+static esp_err_t wiz_control_store_scene(const cJSON *root)
+{
+    static wiz_scene_t scene;
+    cJSON *entries = cJSON_GetObjectItem(root, "entries");
+    memset(&scene, 0, sizeof(scene));
+    if (!wiz_json_name(root, scene.name) || !entries || !cJSON_IsArray(entries)) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Set receive timeout
-    struct timeval timeout;
-    timeout.tv_sec = 3;
-    timeout.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    cJSON *item;
+    cJSON_ArrayForEach(item, entries) {
+        cJSON *mac = cJSON_GetObjectItem(item, "mac");
+        cJSON *on = cJSON_GetObjectItem(item, "on");
+        uint32_t dimming, temp;
+        if (scene.num_entries >= MAX_SCENE_BULBS || !mac || !cJSON_IsString(mac) ||
+            strlen(mac->valuestring) >= WIZ_MAC_LEN || !on || !cJSON_IsBool(on) ||
+            !wiz_json_uint(item, "dimming", 100, &dimming) || !wiz_json_uint(item, "temp", 6500, &temp)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        wiz_scene_entry_t *entry = &scene.entries[scene.num_entries++];
+        strcpy(entry->mac, mac->valuestring);
+        entry->on = cJSON_IsTrue(on);
+        entry->dimming = (uint8_t)dimming;
+        entry->temp = (uint16_t)temp;
+    }
+    return wiz_scene_store(&scene);
+}
 
-    // Send discovery packet
-    struct sockaddr_in dest_addr;
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(WIZ_PORT);
-    dest_addr.sin_addr.s_addr = inet_addr("255.255.255.255");
+static esp_err_t wiz_control_store_group(const cJSON *root)
+{
+    static wiz_group_t group;
+    cJSON *bulbs = cJSON_GetObjectItem(root, "bulbs");
+    memset(&group, 0, sizeof(group));
+    if (!wiz_json_name(root, group.name) || !bulbs || !cJSON_IsArray(bulbs)) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    const char *msg = "{\"method\":\"getPilot\",\"params\":{}}";
-    int err = sendto(sock, msg, strlen(msg), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (err < 0) {
-        ESP_LOGE(WIZ_TAG, "Failed to send discovery packet");
-        close(sock);
+    cJSON *item;
+    cJSON_ArrayForEach(item, bulbs) {
+        if (group.num_bulbs >= MAX_SCENE_BULBS || !cJSON_IsString(item) ||
+            strlen(item->valuestring) >= WIZ_MAC_LEN) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        strcpy(group.macs[group.num_bulbs++], item->valuestring);
+    }
+    return wiz_group_store(&group);
+}
+
+/**
+ * Run one control command and answer the sender
+ */
+static void wiz_control_handle(const cJSON *root, const struct sockaddr_in *from)
+{
+    cJSON *cmd = cJSON_GetObjectItem(root, "cmd");
+    cJSON *on = cJSON_GetObjectItem(root, "on");
+    bool state = on == NULL || cJSON_IsTrue(on);
+    char name[WIZ_NAME_MAX];
+    char extra[256] = "";
+    esp_err_t ret = ESP_ERR_INVALID_ARG;
+
+    if (!cmd || !cJSON_IsString(cmd)) {
+        wiz_control_reply(from, "", ret, NULL);
         return;
     }
 
-    // Listen for responses
-    char rx_buffer[1024];
-    struct sockaddr_in source_addr;
-    socklen_t socklen = sizeof(source_addr);
-    
-    uint32_t start_tick = xTaskGetTickCount();
-    while ((xTaskGetTickCount() - start_tick) < pdMS_TO_TICKS(3000)) {
-        int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
-        if (len > 0) {
-            rx_buffer[len] = 0;
-            
-            cJSON *root = cJSON_Parse(rx_buffer);
-            if (root) {
-                cJSON *result = cJSON_GetObjectItem(root, "result");
-                if (result) {
-                    cJSON *mac_item = cJSON_GetObjectItem(result, "mac");
-                    if (mac_item && cJSON_IsString(mac_item)) {
-                        const char *mac = mac_item->valuestring;
-                        char *ip_str = inet_ntoa(source_addr.sin_addr);
-                        
-                        // Check if this MAC matches any of our configured bulbs
-                        for (int i = 0; i < NUM_SWITCHES; i++) {
-                            for (int j = 0; j < switches[i].num_bulbs; j++) {
-                                if (switches[i].bulb_macs[j] && strcmp(mac, switches[i].bulb_macs[j]) == 0) {
-                                    ESP_LOGI(WIZ_TAG, "Found configured bulb! MAC: %s, IP: %s (Switch %d)", 
-                                             mac, ip_str, i + 1);
-                                    strncpy(switches[i].bulb_ips[j], ip_str, sizeof(switches[i].bulb_ips[j]) - 1);
-                                }
-                            }
-                        }
-                    }
-                }
-                cJSON_Delete(root);
+    if (strcmp(cmd->valuestring, "scene") == 0 || strcmp(cmd->valuestring, "group") == 0) {
+        // Counts come from this apply only - none if the name was bad or unknown
+        wiz_apply_result_t result;
+        bool ran = false;
+        if (wiz_json_name(root, name)) {
+            ret = cmd->valuestring[0] == 's' ? wiz_scene_apply(name, state, WIZ_PRIO_BURST, &result)
+                                             : wiz_group_set_state(name, state, WIZ_PRIO_BURST, &result);
+            ran = ret != ESP_ERR_NOT_FOUND;
+        }
+        if (ran) {
+            snprintf(extra, sizeof(extra), ",\"acked\":%d,\"total\":%d,\"handed\":%d,\"ms\":%lld",
+                     result.acked, result.total, result.handed, (long long)result.elapsed_ms);
+        }
+    } else if (strcmp(cmd->valuestring, "store_scene") == 0) {
+        ret = wiz_control_store_scene(root);
+    } else if (strcmp(cmd->valuestring, "store_group") == 0) {
+        ret = wiz_control_store_group(root);
+    } else if (strcmp(cmd->valuestring, "stats") == 0) {
+        xSemaphoreTake(burst_mutex, portMAX_DELAY);
+        snprintf(extra, sizeof(extra),
+                 ",\"last\":\"%s\",\"acked\":%d,\"total\":%d,\"handed\":%d,\"ms\":%lld,"
+                 "\"sent\":%lu,\"backpressure\":%lu,\"requeues\":%lu,\"dropped\":%lu,\"capacity\":%d",
+                 last_apply.name, last_apply.acked, last_apply.total, last_apply.handed,
+                 (long long)last_apply.elapsed_ms, (unsigned long)net_tx_stats.sent,
+                 (unsigned long)net_tx_stats.backpressure, (unsigned long)net_tx_stats.requeues,
+                 (unsigned long)net_tx_stats.dropped, net_tx_capacity);
+        xSemaphoreGive(burst_mutex);
+        ret = ESP_OK;
+    } else {
+        ret = ESP_ERR_NOT_SUPPORTED;
+    }
+
+    ESP_LOGI(WIZ_TAG, "Control '%s' from %s: %s", cmd->valuestring,
+             inet_ntoa(from->sin_addr), esp_err_to_name(ret));
+    wiz_control_reply(from, cmd->valuestring, ret, extra);
+}
+
+/**
+ * Control task - runs control commands and sends states handed over by peers
+ * A peer's scene or join dump arrives as one state per datagram; they are
+ * gathered while they keep coming and sent as one burst.
+ */
+static void wiz_control_task(void *pvParameters)
+{
+    static wiz_desired_t handoffs[MAX_SCENE_BULBS];
+    wiz_control_msg_t msg;
+    while (1) {
+        if (xQueueReceive(control_queue, &msg, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        int count = 0;
+        while (msg.root == NULL) {
+            handoffs[count++] = msg.handoff;
+            if (count == MAX_SCENE_BULBS ||
+                xQueueReceive(control_queue, &msg, pdMS_TO_TICKS(WIZ_HANDOFF_GATHER_MS)) != pdTRUE) {
+                break;
             }
-        } else {
-            break; // Timeout or error
+        }
+        if (count > 0) {
+            wiz_handoff_send(handoffs, count);
+        }
+
+        // The message that ended the gathering may be a command
+        if (msg.root != NULL) {
+            wiz_control_handle(msg.root, &msg.from);
+            cJSON_Delete(msg.root);
         }
     }
+}
 
-    close(sock);
-    ESP_LOGI(WIZ_TAG, "Discovery complete");
+/**
+ * Start the control task that runs scene, group and stats commands sent to this
+ * controller on the coordination port, and sends states handed over by peers
+ */
+esp_err_t wiz_control_init(void)
+{
+    control_queue = xQueueCreate(WIZ_CONTROL_QUEUE_LEN, sizeof(wiz_control_msg_t));
+    if (control_queue == NULL) {
+        ESP_LOGE(WIZ_TAG, "Failed to create control queue");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(wiz_control_task, "wiz_control", 6144, NULL, 6, NULL) != pdPASS) {
+        ESP_LOGE(WIZ_TAG, "Failed to create control task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
 // ========== Button GPIO Functions ==========
@@ -390,7 +2567,7 @@ static void IRAM_ATTR toggle_isr_handler(void* arg)
     }
     
     // Notify the toggle handler task (pass switch index in notification)
-    uint32_t switch_index = (uint32_t)arg;
+    uint32_t switch_index = (uint32_t)(uintptr_t)arg;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     xTaskNotifyFromISR(button_task_handle, (1UL << switch_index), eSetBits, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
@@ -452,7 +2629,7 @@ void toggle_gpio_init(void)
     // Add ISR handler for each switch (pass switch index as argument)
     // NOTE: Do NOT call gpio_reset_pin() here - it would clear the config!
     for (int i = 0; i < NUM_SWITCHES; i++) {
-        gpio_isr_handler_add(switches[i].gpio_pin, toggle_isr_handler, (void*)i);
+        gpio_isr_handler_add(switches[i].gpio_pin, toggle_isr_handler, (void *)(uintptr_t)i);
         
         // Read initial state with debouncing
         int level = read_toggle_state_debounced(switches[i].gpio_pin);
@@ -463,7 +2640,7 @@ void toggle_gpio_init(void)
         // Switches 2-5: HIGH=ON LOW=OFF (invert_logic=true)
         bool desired_state = switches[i].invert_logic ? (level == 1) : (level == 0);
         for (int j = 0; j < switches[i].num_bulbs; j++) {
-            switches[i].bulb_states[j] = desired_state;
+            wiz_coord_seed(switches[i].bulb_macs[j], desired_state);
         }
         
         ESP_LOGI(WIZ_TAG, "Switch %d (GPIO %d) initialized, level: %d, bulbs: %d", 
@@ -502,65 +2679,74 @@ void led_status_blink(uint32_t count, uint32_t delay_ms)
 }
 
 /**
- * Sync bulbs for a specific switch with its toggle state
+ * Sync all bulbs this controller owns with their desired state
+ * Desired state is shared with peer controllers, so a bulb changed elsewhere
+ * is never reverted to this controller's switch position.
  */
-static bool sync_switch_bulbs(int switch_idx)
+static bool sync_all_bulbs(void)
 {
-    if (switch_idx < 0 || switch_idx >= NUM_SWITCHES || !wifi_connected) {
+    if (sync_in_progress || !wifi_connected) {
         return false;
     }
     
-    switch_config_t* sw = &switches[switch_idx];
-    
-    // Read toggle state with debouncing
-    int toggle_state = read_toggle_state_debounced(sw->gpio_pin);
-    
-    // Apply logic based on switch's invert_logic setting
-    // Switch 1: LOW=ON HIGH=OFF (invert_logic=false)
-    // Switches 2-5: HIGH=ON LOW=OFF (invert_logic=true)
-    bool desired_bulb_state = sw->invert_logic ? (toggle_state == 1) : (toggle_state == 0);
-    
-    bool all_synced = true;
+    sync_in_progress = true;
+    bool all_ok = true;
     
-    // Sync all bulbs for this switch
-    for (int i = 0; i < sw->num_bulbs; i++) {
-        if (sw->bulb_states[i] != desired_bulb_state) {
-            ESP_LOGI(WIZ_TAG, "Syncing Switch %d: Toggle=%d (bulb=%s), Bulb %s current=%s", 
-                     switch_idx + 1, toggle_state, desired_bulb_state ? "ON" : "OFF",
-                     sw->bulb_ips[i], sw->bulb_states[i] ? "ON" : "OFF");
-            
-            esp_err_t ret = wiz_set_state(sw->bulb_ips[i], desired_bulb_state);
-            if (ret == ESP_OK) {
-                sw->bulb_states[i] = desired_bulb_state;
-            } else {
-                all_synced = false;
-            }
+    for (int i = 0; i < MAX_DESIRED; i++) {
+        wiz_desired_t entry;
+        if (!wiz_coord_unapplied(i, &entry)) {
+            continue;
+        }
+        
+        const char *ip = wiz_lookup_bulb_ip(entry.mac);
+        if (ip == NULL) {
+            all_ok = false;
+            continue;
+        }
+        
+        // A flip may have replaced the entry since it was copied out
+        if (!wiz_coord_is_current(&entry)) {
+            continue;
+        }
+        
+        ESP_LOGI(WIZ_TAG, "Syncing bulb %s (%s) -> %s (v%lu)",
+                 entry.mac, ip, entry.on ? "ON" : "OFF", (unsigned long)entry.version);
+        
+        esp_err_t ret = wiz_set_pilot(ip, entry.on, entry.dimming, entry.temp, WIZ_PRIO_RECONCILE);
+        if (ret == ESP_OK) {
+            wiz_coord_mark_applied(&entry);
+        } else if (ret == ESP_ERR_INVALID_STATE) {
+            // A flip went out while this was queued; its own send owns the entry now
+            ESP_LOGD(WIZ_TAG, "Sync of %s superseded by interactive send", ip);
+        } else {
+            all_ok = false;
         }
     }
     
-    return all_synced;
+    sync_in_progress = false;
+    return all_ok;
 }
 
 /**
- * Sync all switches with their bulbs
+ * Periodic sync task - runs reconciliation at low priority in its own task
+ * so a slow sync never delays toggle detection or interactive sends
  */
-static bool sync_all_switches(void)
+void sync_task(void *pvParameters)
 {
-    if (sync_in_progress || !wifi_connected) {
-        return false;
-    }
+    const uint32_t SYNC_INTERVAL_MS = 2000;  // Full sync every 2 seconds
     
-    sync_in_progress = true;
-    bool all_ok = true;
+    // Sync initial state for all switches
+    if (wifi_connected) {
+        sync_all_bulbs();
+    }
     
-    for (int i = 0; i < NUM_SWITCHES; i++) {
-        if (!sync_switch_bulbs(i)) {
-            all_ok = false;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SYNC_INTERVAL_MS));
+        
+        if (wifi_connected) {
+            sync_all_bulbs();
         }
     }
-    
-    sync_in_progress = false;
-    return all_ok;
 }
 
 /**
@@ -573,8 +2759,6 @@ void button_handler_task(void *pvParameters)
     uint32_t last_change_times[NUM_SWITCHES] = {0};
     const uint32_t DEBOUNCE_MS = 50;  // Debounce time
     const uint32_t POLL_INTERVAL_MS = 100;  // Poll every 100ms to catch missed interrupts
-    const uint32_t SYNC_INTERVAL_MS = 2000;  // Full sync every 2 seconds
-    uint32_t last_sync_time = 0;
     
     ESP_LOGI(WIZ_TAG, "Toggle switch handler task started for %d switches", NUM_SWITCHES);
     
@@ -589,19 +2773,12 @@ void button_handler_task(void *pvParameters)
         ESP_LOGW(WIZ_TAG, "WiFi not connected, toggle handler will wait");
     }
     
-    // Sync initial state for all switches
-    if (wifi_connected) {
-        sync_all_switches();
-    }
-    
-    last_sync_time = xTaskGetTickCount();
-    
     while (1) {
         uint32_t now = xTaskGetTickCount();
         
         // Check for interrupt notifications (fast path) - non-blocking check
         // Note: We use polling as primary method, interrupts are just optimization
-        xTaskNotifyWait(0x00, ULONG_MAX, &notification_value, 0);
+        xTaskNotifyWait(0x00, UINT32_MAX, &notification_value, 0);
         
         // Process each switch
         for (int i = 0; i < NUM_SWITCHES; i++) {
@@ -650,13 +2827,36 @@ void button_handler_task(void *pvParameters)
                 // Control all bulbs for this switch
                 bool all_success = true;
                 for (int j = 0; j < sw->num_bulbs; j++) {
-                    ESP_LOGI(WIZ_TAG, "  Setting bulb %s to %s", sw->bulb_ips[j], new_bulb_state ? "ON" : "OFF");
+                    ESP_LOGI(WIZ_TAG, "  Setting bulb %s to %s", sw->bulb_macs[j], new_bulb_state ? "ON" : "OFF");
+                    
+                    // Only the owning controller sends; peers pick the change up from the group
+                    wiz_desired_t desired;
+                    if (!wiz_coord_publish(sw->bulb_macs[j], new_bulb_state, 0, 0, &desired)) {
+                        ESP_LOGI(WIZ_TAG, "  Bulb %s is owned by a peer controller", sw->bulb_macs[j]);
+                        continue;
+                    }
                     
-                    esp_err_t ret = wiz_set_state(sw->bulb_ips[j], new_bulb_state);
+                    // Nobody has discovered the bulb - there is no address to send to
+                    const char *ip = wiz_lookup_bulb_ip(sw->bulb_macs[j]);
+                    if (ip == NULL) {
+                        ESP_LOGW(WIZ_TAG, "  Bulb %s not discovered, skipping", sw->bulb_macs[j]);
+                        all_success = false;
+                        continue;
+                    }
+                    
+                    esp_err_t ret = wiz_set_state(ip, new_bulb_state, WIZ_PRIO_INTERACTIVE);
                     if (ret == ESP_OK) {
-                        sw->bulb_states[j] = new_bulb_state;
+                        wiz_coord_mark_applied(&desired);
                     } else {
-                        ESP_LOGE(WIZ_TAG, "  Failed to control bulb %s", sw->bulb_ips[j]);
+                        ESP_LOGE(WIZ_TAG, "  Failed to control bulb %s (%s)", sw->bulb_macs[j], ip);
+                        all_success = false;
+                    }
+                }
+                
+                // Scene-bound switch: ON applies the scene, OFF turns its bulbs off
+                if (sw->scene_name) {
+                    ESP_LOGI(WIZ_TAG, "  Scene '%s' -> %s", sw->scene_name, new_bulb_state ? "apply" : "off");
+                    if (wiz_scene_apply(sw->scene_name, new_bulb_state, WIZ_PRIO_BURST, NULL) != ESP_OK) {
                         all_success = false;
                     }
                 }
@@ -671,12 +2871,6 @@ void button_handler_task(void *pvParameters)
             }
         }
         
-        // Periodic sync check (every 2 seconds)
-        if (wifi_connected && (now - last_sync_time >= pdMS_TO_TICKS(SYNC_INTERVAL_MS))) {
-            sync_all_switches();
-            last_sync_time = now;
-        }
-        
         // Poll interval - check toggle state frequently
         vTaskDelay(pdMS_TO_TICKS(POLL_INTERVAL_MS));
     }
@@ -688,9 +2882,18 @@ void app_main(void)
     ESP_LOGI(WIZ_TAG, "WiZ Bulb Controller - Simple Version");
     ESP_LOGI(WIZ_TAG, "========================================");
     
+    // Start the network scheduler before WiFi so the socket has an owner
+    if (wiz_net_init() != ESP_OK) {
+        ESP_LOGE(WIZ_TAG, "Network scheduler failed to start!");
+        return;
+    }
+    
     // Initialize WiFi
     wifi_init();
     
+    // Load scenes and groups (NVS is initialized by wifi_init)
+    wiz_scenes_init();
+    
     // Initialize status LED
     led_status_init();
     
@@ -714,6 +2917,23 @@ void app_main(void)
     // Discover bulbs on the network
     wiz_discover_bulbs();
     
+    // Scene and group commands from the LAN arrive on the coordination socket, and
+    // peers' states this controller owns are sent from the same task - start it first
+    if (wiz_control_init() != ESP_OK) {
+        ESP_LOGW(WIZ_TAG, "Running without remote control");
+    }
+    
+    // Coordinate with other controllers sharing these bulbs
+    if (wiz_coord_init() != ESP_OK) {
+        ESP_LOGW(WIZ_TAG, "Running without multi-controller coordination");
+    }
+    
+    // Let peers' state and clocks arrive before switches seed or publish anything,
+    // so a rebooted controller neither reverts bulbs nor issues versions peers reject
+    while (!wiz_coord_settled()) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    
     // Create toggle handler task FIRST (before initializing GPIO)
     xTaskCreate(button_handler_task, "toggle_handler", 8192, NULL, 10, &button_task_handle);
     vTaskDelay(pdMS_TO_TICKS(100)); // Give task time to start
@@ -721,6 +2941,9 @@ void app_main(void)
     // Initialize toggle switch GPIO (after task is created)
     toggle_gpio_init();
     
+    // Background reconciliation runs below the toggle handler priority
+    xTaskCreate(sync_task, "sync", 4096, NULL, 5, NULL);
+    
     ESP_LOGI(WIZ_TAG, "========================================");
     ESP_LOGI(WIZ_TAG, "System ready!");
     ESP_LOGI(WIZ_TAG, "Configured %d switches controlling bulbs:", NUM_SWITCHES);